@@ -0,0 +1,63 @@
+#!/bin/sh
+#
+# Summarize, or compare, runtime.tsv reports of runtime_bench.sh.
+#
+# usage: compare_runtime.sh report [baseline]
+#
+# Prints the median seconds, cycles and instructions of each kernel and
+# configuration.  Given a baseline report, such as one from an earlier
+# build of tipc, it also prints the baseline median time and the speedup
+# over it.
+
+if [ $# -lt 1 ]; then
+  echo "usage: $0 report [baseline]"
+  exit 1
+fi
+
+# the median of each column, by kernel and configuration
+medians() {
+  awk -F '\t' '
+    $1 != "kernel" {
+      key = $1 "\t" $2
+      n = ++count[key]
+      for (c = 4; c <= 6; c++) {
+        values[key, c, n] = $c
+      }
+    }
+    END {
+      for (key in count) {
+        line = key
+        for (c = 4; c <= 6; c++) {
+          # insertion sort, there are only a few runs
+          for (i = 1; i <= count[key]; i++) {
+            v[i] = values[key, c, i]
+            for (j = i; j > 1 && v[j - 1] + 0 > v[j] + 0; j--) {
+              t = v[j]; v[j] = v[j - 1]; v[j - 1] = t
+            }
+          }
+          line = line "\t" v[int((count[key] + 1) / 2)]
+        }
+        print line
+      }
+    }' $1 | sort
+}
+
+if [ $# -lt 2 ]; then
+  printf "kernel\tconfig\tseconds\tcycles\tinstructions\n"
+  medians $1
+  exit 0
+fi
+
+medians $2 > /tmp/baseline.$$
+printf "kernel\tconfig\tseconds\tcycles\tinstructions\tbaseline\tspeedup\n"
+medians $1 | awk -F '\t' -v OFS='\t' '
+  FILENAME != "-" { base[$1 "\t" $2] = $3; next }
+  {
+    key = $1 "\t" $2
+    if (key in base && $3 > 0) {
+      print $0, base[key], sprintf("%.2f", base[key] / $3)
+    } else {
+      print $0, "-", "-"
+    }
+  }' /tmp/baseline.$$ -
+rm -f /tmp/baseline.$$
@@ -0,0 +1,78 @@
+#!/bin/sh
+#
+# Measure how the phases of tipc scale with the size of the program.
+#
+# usage: compile_bench.sh tipc tipgen outdir [functions...]
+#
+# Programs with each number of functions are generated by tipgen and
+# compiled with type inference and -O2.  The wall time of each phase is
+# taken from the -time-phases-json report and collected in
+# outdir/compile.tsv, one line per program and phase.  A phase whose time
+# per line grows more than twice as fast as the program is reported as
+# superlinear.
+#
+# TIPGEN_FLAGS can be set to change the shape of the programs.
+
+if [ $# -lt 3 ]; then
+  echo "usage: $0 tipc tipgen outdir [functions...]"
+  exit 1
+fi
+
+TIPC=$1
+TIPGEN=$2
+OUT=$3
+shift 3
+
+# about 100 lines per function, so about 10k to 1M lines
+SIZES=${*:-"100 1000 10000"}
+
+mkdir -p $OUT
+cd $OUT
+REPORT=compile.tsv
+printf "lines\tfunctions\tphase\twall\n" > $REPORT
+
+for n in $SIZES; do
+  prog=gen_$n.tip
+  $TIPGEN -functions $n $TIPGEN_FLAGS > $prog
+  lines=`wc -l < $prog`
+
+  echo "compiling $prog, $lines lines"
+  if ! $TIPC -t -O2 -time-phases-json gen_$n.json $prog > /dev/null; then
+    echo "tipc failed on $prog"
+    exit 1
+  fi
+
+  # entries are "time.<file>.<phase>.wall": <seconds>
+  grep "\"time\.$prog\.[a-zA-Z-]*\.wall\"" gen_$n.json |
+    sed -e "s/.*time\.$prog\.\([a-zA-Z-]*\)\.wall\": *\([0-9.e+-]*\).*/\1 \2/" |
+    while read phase wall; do
+      printf "%s\t%s\t%s\t%s\n" $lines $n $phase $wall >> $REPORT
+    done
+done
+
+cat $REPORT
+
+# compare the time per line of the smallest and largest programs
+awk -F '\t' '
+  NR > 1 {
+    if (!($3 in minLines) || $1 < minLines[$3]) {
+      minLines[$3] = $1; minWall[$3] = $4
+    }
+    if (!($3 in maxLines) || $1 > maxLines[$3]) {
+      maxLines[$3] = $1; maxWall[$3] = $4
+    }
+  }
+  END {
+    status = 0
+    for (p in minLines) {
+      # phases that are too quick to time reliably are skipped
+      if (maxLines[p] == minLines[p] || minWall[p] < 0.001) continue
+      growth = (maxWall[p] / maxLines[p]) / (minWall[p] / minLines[p])
+      if (growth > 2) {
+        printf "superlinear: %s per line is %.1fx slower at %d lines\n",
+               p, growth, maxLines[p]
+        status = 1
+      }
+    }
+    exit status
+  }' $REPORT
@@ -0,0 +1,80 @@
+#!/bin/sh
+#
+# Measure the speed of the code that tipc generates.
+#
+# usage: runtime_bench.sh tipc outdir
+#
+# Each kernel in kernels/ is compiled to an executable at each
+# optimization level, untyped and with type inference, and run RUNS
+# times, 5 by default, with the fixed arguments given below, which reach
+# main through _tip_input_array.  Every run is recorded in
+# outdir/runtime.tsv with its time in seconds and, when perf is
+# available, its cycles and instructions.  The medians are summarized by
+# compare_runtime.sh, which also compares the reports of two builds.
+
+if [ $# -lt 2 ]; then
+  echo "usage: $0 tipc outdir"
+  exit 1
+fi
+
+TIPC=$1
+OUT=$2
+BENCH=`cd \`dirname $0\` && pwd`
+KERNELS=$BENCH/kernels
+RUNS=${RUNS:-5}
+
+# the arguments of each kernel
+args() {
+  case $1 in
+    matrix) echo 2000000 ;;
+    fib) echo 32 ;;
+    ptrchase) echo 1000000 100 ;;
+    interval) echo 10000 100000 ;;
+  esac
+}
+
+if perf stat -x, -e cycles true 2>/dev/null; then
+  PERF=1
+fi
+
+mkdir -p $OUT
+cd $OUT
+REPORT=runtime.tsv
+printf "kernel\tconfig\trun\tseconds\tcycles\tinstructions\n" > $REPORT
+
+for kernel in matrix fib ptrchase interval; do
+  for level in -O0 -O1 -O2 -O3; do
+    for typed in "" -t; do
+      config=$level$typed
+      exe=$kernel$config
+      if ! $TIPC $level $typed -o $exe $KERNELS/$kernel.tip > /dev/null; then
+        echo "tipc failed on $kernel $config"
+        exit 1
+      fi
+
+      run=1
+      while [ $run -le $RUNS ]; do
+        if [ -n "$PERF" ]; then
+          # perf writes "value,unit,event,..." lines
+          perf stat -x, -e task-clock,cycles,instructions -o $exe.perf \
+            ./$exe `args $kernel` > /dev/null
+          seconds=`awk -F, '$3 ~ /^task-clock/ { print $1 / 1000 }' $exe.perf`
+          cycles=`awk -F, '$3 ~ /^cycles/ { print $1 }' $exe.perf`
+          instructions=`awk -F, '$3 ~ /^instructions/ { print $1 }' $exe.perf`
+        else
+          start=`date +%s.%N`
+          ./$exe `args $kernel` > /dev/null
+          end=`date +%s.%N`
+          seconds=`echo "$start $end" | awk '{ print $2 - $1 }'`
+          cycles=-
+          instructions=-
+        fi
+        printf "%s\t%s\t%d\t%s\t%s\t%s\n" $kernel $config $run $seconds \
+          $cycles $instructions >> $REPORT
+        run=`expr $run + 1`
+      done
+    done
+  done
+done
+
+$BENCH/compare_runtime.sh $REPORT
@@ -0,0 +1,196 @@
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+/*
+ * tipgen - a generator of synthetic TIP programs for benchmarking tipc
+ *
+ * The programs are well typed and terminate.  Every function "fN(a, b)"
+ * takes and returns integers and has integer locals and a single pointer
+ * to an integer.  Functions only call functions with larger numbers, so
+ * the call graph is acyclic, and loops count down a dedicated counter.
+ * The size of the program is controlled by the number of functions and
+ * statements, and its shape by the nesting depth of statements and
+ * expressions, the density of pointer operations and the call fan-out.
+ */
+
+static cl::OptionCategory GENcat("tipgen Options",
+                                 "Options for the shape of the program.");
+static cl::opt<unsigned> numFunctions("functions",
+                                      cl::desc("number of functions"),
+                                      cl::init(100), cl::cat(GENcat));
+static cl::opt<unsigned>
+    numStatements("statements",
+                  cl::desc("number of statements in each function body"),
+                  cl::init(20), cl::cat(GENcat));
+static cl::opt<unsigned>
+    maxDepth("depth",
+             cl::desc("nesting depth of statements and expressions"),
+             cl::init(3), cl::cat(GENcat));
+static cl::opt<unsigned>
+    pointerDensity("pointers",
+                   cl::desc("percentage of statements that are pointer "
+                            "operations"),
+                   cl::init(20), cl::cat(GENcat));
+static cl::opt<unsigned>
+    fanOut("fanout", cl::desc("number of calls made by each function"),
+           cl::init(2), cl::cat(GENcat));
+static cl::opt<unsigned> seed("seed", cl::desc("random seed"), cl::init(1),
+                              cl::cat(GENcat));
+
+// the integer locals of every function
+static const unsigned numLocals = 4;
+
+class Generator {
+  raw_ostream *os;
+  std::mt19937 rng;
+  unsigned function = 0;
+  unsigned callsLeft = 0;
+  unsigned loopCounter = 0;
+
+  unsigned pick(unsigned n) {
+    return std::uniform_int_distribution<unsigned>(0, n - 1)(rng);
+  }
+
+  void indent(unsigned level) { os->indent(2 * level); }
+
+  std::string local() { return "x" + std::to_string(pick(numLocals)); }
+
+  std::string leaf() {
+    switch (pick(5)) {
+    case 0:
+      return std::to_string(pick(100));
+    case 1:
+      return "a";
+    case 2:
+      return "b";
+    case 3:
+      return "*p";
+    default:
+      return local();
+    }
+  }
+
+  std::string expr(unsigned depth) {
+    if (depth == 0) {
+      return leaf();
+    }
+    if (callsLeft > 0 && function + 1 < numFunctions && pick(4) == 0) {
+      callsLeft--;
+      unsigned callee = function + 1 + pick(numFunctions - function - 1);
+      return "f" + std::to_string(callee) + "(" + expr(depth - 1) + ", " +
+             expr(depth - 1) + ")";
+    }
+    static const char *ops[] = {" + ", " - ", " * ", " > ", " == "};
+    return "(" + expr(depth - 1) + ops[pick(5)] + expr(depth - 1) + ")";
+  }
+
+  void pointerStmt(unsigned level) {
+    indent(level);
+    switch (pick(3)) {
+    case 0:
+      *os << "p = alloc " << expr(maxDepth) << ";\n";
+      break;
+    case 1:
+      *os << "p = &" << local() << ";\n";
+      break;
+    default:
+      *os << "*p = " << expr(maxDepth) << ";\n";
+      break;
+    }
+  }
+
+  void stmt(unsigned level, unsigned depth) {
+    if (pick(100) < pointerDensity) {
+      pointerStmt(level);
+      return;
+    }
+
+    unsigned kind = depth > 0 ? pick(4) : 0;
+    if (kind == 1) {
+      indent(level);
+      *os << "if (" << expr(maxDepth) << ") {\n";
+      stmt(level + 1, depth - 1);
+      indent(level);
+      *os << "} else {\n";
+      stmt(level + 1, depth - 1);
+      indent(level);
+      *os << "}\n";
+    } else if (kind == 2) {
+      std::string counter = "c" + std::to_string(loopCounter++);
+      indent(level);
+      *os << counter << " = " << pick(10) << ";\n";
+      indent(level);
+      *os << "while (" << counter << " > 0) {\n";
+      indent(level + 1);
+      *os << counter << " = " << counter << " - 1;\n";
+      stmt(level + 1, depth - 1);
+      indent(level);
+      *os << "}\n";
+    } else {
+      indent(level);
+      *os << local() << " = " << expr(maxDepth) << ";\n";
+    }
+  }
+
+  void genFunction() {
+    callsLeft = fanOut;
+    loopCounter = 0;
+
+    // the body is generated first as it determines the loop counters
+    std::string body;
+    raw_ostream *out = os;
+    raw_string_ostream bodyOS(body);
+    os = &bodyOS;
+    for (unsigned s = 0; s < numStatements; s++) {
+      stmt(1, maxDepth);
+    }
+    bodyOS.flush();
+    os = out;
+
+    *os << "f" << function << "(a, b) {\n";
+    *os << "  var p";
+    for (unsigned l = 0; l < numLocals; l++) {
+      *os << ", x" << l;
+    }
+    for (unsigned c = 0; c < loopCounter; c++) {
+      *os << ", c" << c;
+    }
+    *os << ";\n";
+    *os << "  p = alloc a;\n";
+    for (unsigned l = 0; l < numLocals; l++) {
+      *os << "  x" << l << " = b;\n";
+    }
+    *os << body;
+    *os << "  return " << expr(1) << ";\n";
+    *os << "}\n\n";
+  }
+
+public:
+  Generator(raw_ostream &os, unsigned seed) : os(&os), rng(seed) {}
+
+  void genProgram() {
+    for (function = 0; function < numFunctions; function++) {
+      genFunction();
+    }
+    *os << "main() {\n";
+    if (numFunctions > 0) {
+      *os << "  output f0(1, 2);\n";
+    }
+    *os << "  return 0;\n";
+    *os << "}\n";
+  }
+};
+
+int main(int argc, const char *argv[]) {
+  cl::HideUnrelatedOptions(GENcat);
+  cl::ParseCommandLineOptions(argc, argv,
+                              "tipgen - generate a TIP program on stdout\n");
+
+  Generator(outs(), seed).genProgram();
+  return 0;
+}
@@ -0,0 +1,14 @@
+# Write the contents of the file INPUT to the C++ source OUTPUT as the
+# array SYMBOL, and its size as SYMBOLSize.
+#
+# usage: cmake -DINPUT=file -DOUTPUT=file.cpp -DSYMBOL=name -P EmbedFile.cmake
+
+file(READ ${INPUT} contents HEX)
+string(LENGTH "${contents}" length)
+math(EXPR size "${length} / 2")
+string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${contents}")
+file(WRITE ${OUTPUT}
+     "#include <cstddef>\n"
+     "// bitcode is read a word at a time\n"
+     "alignas(4) extern const unsigned char ${SYMBOL}[] = {${bytes}};\n"
+     "extern const size_t ${SYMBOL}Size = ${size};\n")
@@ -1,2 +1,6 @@
 #!/bin/sh
-clang-7 -c -emit-llvm tip_intrinsics.c
+clang-7 -c -emit-llvm tip_intrinsics.c -o tip_intrinsics_io.bc
+clang-7 -c -emit-llvm tip_gc.c
+clang-7 -c -emit-llvm tip_memo.c
+llvm-link-7 tip_intrinsics_io.bc tip_gc.bc tip_memo.bc -o tip_intrinsics.bc
+rm tip_intrinsics_io.bc tip_gc.bc tip_memo.bc
@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "tip_gc.h"
+
+/*
+ * A mark-sweep collector for programs compiled with tipc -gc.
+ *
+ * The collector is mostly-precise: compiled code records the exact stack
+ * slots of every active function in the shadow stack, but since TIP
+ * values are all 64-bit integers, a slot or heap word is treated as a
+ * pointer whenever it holds the address of an allocated object.  Objects
+ * are never moved.
+ *
+ * The heap is carved out of one large reserved address range so that
+ * deciding whether a word points into the heap is a range check.  The
+ * range is split into blocks; a small block holds objects of a single
+ * size, tracked by allocation and mark bitmaps, and a large object takes
+ * a run of whole blocks.  Free small objects are threaded onto per size
+ * free lists, which are rebuilt by each sweep.
+ */
+#define GC_BLOCK_SIZE ((size_t)1 << 20)
+#define GC_MAX_BLOCKS ((size_t)1 << 16)
+#define GC_MAX_SMALL_WORDS 256
+#define GC_MIN_THRESHOLD ((size_t)4 << 20)
+
+struct gc_block {
+  uint32_t words;   // words per object, 0 if the block is unused
+  uint32_t nobjs;   // objects in the block, 0 if it continues a large object
+  uint32_t nblocks; // blocks spanned by a large object
+  uint64_t *alloc_bits;
+  uint64_t *mark_bits;
+};
+
+struct tip_gc_frame *_tip_gc_frames = NULL;
+
+static char *heap_base = NULL;
+static size_t heap_blocks = 0; // blocks of the range in use so far
+static struct gc_block blocks[GC_MAX_BLOCKS];
+
+// free lists of small objects, linked through their first word
+static void *free_lists[GC_MAX_SMALL_WORDS + 1];
+
+static size_t allocated_since_gc = 0;
+static size_t live_after_gc = 0;
+
+// the explicit stack of marked objects whose words must be scanned
+static int64_t **mark_stack = NULL;
+static size_t mark_top = 0, mark_cap = 0;
+
+static void out_of_memory() {
+  fprintf(stderr, "Error: out of memory\n");
+  exit(-1);
+}
+
+static int test_bit(uint64_t *bits, size_t i) {
+  return (bits[i / 64] >> (i % 64)) & 1;
+}
+
+static void set_bit(uint64_t *bits, size_t i) {
+  bits[i / 64] |= (uint64_t)1 << (i % 64);
+}
+
+static void clear_bit(uint64_t *bits, size_t i) {
+  bits[i / 64] &= ~((uint64_t)1 << (i % 64));
+}
+
+static char *block_addr(size_t b) { return heap_base + b * GC_BLOCK_SIZE; }
+
+static void reserve_heap() {
+  heap_base = mmap(NULL, GC_BLOCK_SIZE * GC_MAX_BLOCKS, PROT_NONE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (heap_base == MAP_FAILED) {
+    out_of_memory();
+  }
+}
+
+/*
+ * Find a run of n unused blocks, reusing released blocks before growing
+ * into the reserved range, and make them accessible.
+ */
+static size_t take_blocks(size_t n) {
+  size_t start = 0, run = 0;
+  for (size_t b = 0; b < heap_blocks && run < n; b++) {
+    if (blocks[b].words == 0) {
+      if (run++ == 0) {
+        start = b;
+      }
+    } else {
+      run = 0;
+    }
+  }
+
+  if (run < n) {
+    if (run == 0) {
+      start = heap_blocks;
+    }
+    if (start + n > GC_MAX_BLOCKS) {
+      out_of_memory();
+    }
+    heap_blocks = start + n;
+  }
+
+  if (mprotect(block_addr(start), n * GC_BLOCK_SIZE,
+               PROT_READ | PROT_WRITE) != 0) {
+    out_of_memory();
+  }
+  return start;
+}
+
+static void release_blocks(size_t b) {
+  size_t n = blocks[b].nblocks;
+  free(blocks[b].alloc_bits);
+  free(blocks[b].mark_bits);
+  memset(&blocks[b], 0, n * sizeof(struct gc_block));
+  madvise(block_addr(b), n * GC_BLOCK_SIZE, MADV_DONTNEED);
+}
+
+static void init_block(size_t b, uint32_t words, uint32_t nobjs,
+                       uint32_t nblocks) {
+  size_t nwords = (nobjs + 63) / 64;
+  blocks[b].words = words;
+  blocks[b].nobjs = nobjs;
+  blocks[b].nblocks = nblocks;
+  blocks[b].alloc_bits = calloc(nwords, sizeof(uint64_t));
+  blocks[b].mark_bits = calloc(nwords, sizeof(uint64_t));
+  if (blocks[b].alloc_bits == NULL || blocks[b].mark_bits == NULL) {
+    out_of_memory();
+  }
+}
+
+// Thread the objects of a new small block onto its free list
+static void add_small_block(uint32_t words) {
+  size_t b = take_blocks(1);
+  uint32_t nobjs = GC_BLOCK_SIZE / (words * 8);
+  init_block(b, words, nobjs, 1);
+
+  char *base = block_addr(b);
+  for (uint32_t i = nobjs; i > 0; i--) {
+    void **obj = (void **)(base + (size_t)(i - 1) * words * 8);
+    *obj = free_lists[words];
+    free_lists[words] = obj;
+  }
+}
+
+// Mark the object that a value refers to, if it is a heap address
+static void mark_value(int64_t value) {
+  char *addr = (char *)value;
+  if (addr < heap_base || addr >= block_addr(heap_blocks)) {
+    return;
+  }
+
+  size_t b = (addr - heap_base) / GC_BLOCK_SIZE;
+  struct gc_block *block = &blocks[b];
+  if (block->words == 0 || block->nobjs == 0) {
+    return;
+  }
+
+  size_t offset = addr - block_addr(b);
+  size_t size = (size_t)block->words * 8;
+  size_t i = offset / size;
+  if (offset % size != 0 || i >= block->nobjs ||
+      !test_bit(block->alloc_bits, i) || test_bit(block->mark_bits, i)) {
+    return;
+  }
+  set_bit(block->mark_bits, i);
+
+  if (mark_top == mark_cap) {
+    mark_cap = mark_cap == 0 ? 1024 : mark_cap * 2;
+    mark_stack = realloc(mark_stack, mark_cap * sizeof(int64_t *));
+    if (mark_stack == NULL) {
+      out_of_memory();
+    }
+  }
+  mark_stack[mark_top++] = (int64_t *)addr;
+}
+
+static void mark() {
+  for (struct tip_gc_frame *frame = _tip_gc_frames; frame != NULL;
+       frame = frame->prev) {
+    for (int64_t r = 0; r < frame->nroots; r++) {
+      mark_value(*frame->roots[r]);
+    }
+  }
+
+  while (mark_top > 0) {
+    int64_t *obj = mark_stack[--mark_top];
+    size_t b = ((char *)obj - heap_base) / GC_BLOCK_SIZE;
+    for (uint32_t w = 0; w < blocks[b].words; w++) {
+      mark_value(obj[w]);
+    }
+  }
+}
+
+static void sweep() {
+  memset(free_lists, 0, sizeof(free_lists));
+  live_after_gc = 0;
+
+  for (size_t b = 0; b < heap_blocks; b++) {
+    struct gc_block *block = &blocks[b];
+    if (block->words == 0 || block->nobjs == 0) {
+      continue;
+    }
+
+    size_t size = (size_t)block->words * 8;
+    size_t live = 0;
+    for (uint32_t i = 0; i < block->nobjs; i++) {
+      if (test_bit(block->mark_bits, i)) {
+        clear_bit(block->mark_bits, i);
+        live++;
+      } else {
+        clear_bit(block->alloc_bits, i);
+      }
+    }
+    live_after_gc += live * size;
+
+    if (live == 0) {
+      release_blocks(b);
+    } else if (block->words <= GC_MAX_SMALL_WORDS) {
+      char *base = block_addr(b);
+      for (uint32_t i = block->nobjs; i > 0; i--) {
+        if (!test_bit(block->alloc_bits, i - 1)) {
+          void **obj = (void **)(base + (size_t)(i - 1) * size);
+          *obj = free_lists[block->words];
+          free_lists[block->words] = obj;
+        }
+      }
+    }
+  }
+}
+
+static void collect() {
+  mark();
+  sweep();
+  allocated_since_gc = 0;
+}
+
+char *_tip_gc_alloc(int64_t size) {
+  if (heap_base == NULL) {
+    reserve_heap();
+  }
+
+  size_t words = size <= 0 ? 1 : ((size_t)size + 7) / 8;
+  size_t bytes = words * 8;
+
+  // collect once the heap has grown by as much as survived the last cycle
+  size_t threshold =
+      live_after_gc > GC_MIN_THRESHOLD ? live_after_gc : GC_MIN_THRESHOLD;
+  if (allocated_since_gc + bytes > threshold) {
+    collect();
+  }
+  allocated_since_gc += bytes;
+
+  if (words > GC_MAX_SMALL_WORDS) {
+    size_t n = (bytes + GC_BLOCK_SIZE - 1) / GC_BLOCK_SIZE;
+    size_t b = take_blocks(n);
+    init_block(b, words, 1, n);
+    for (size_t c = 1; c < n; c++) {
+      blocks[b + c].words = words; // continuation blocks hold no objects
+    }
+    set_bit(blocks[b].alloc_bits, 0);
+    return block_addr(b);
+  }
+
+  if (free_lists[words] == NULL) {
+    add_small_block(words);
+  }
+  void **obj = free_lists[words];
+  free_lists[words] = *obj;
+
+  size_t b = ((char *)obj - heap_base) / GC_BLOCK_SIZE;
+  set_bit(blocks[b].alloc_bits, ((char *)obj - block_addr(b)) / bytes);
+  memset(obj, 0, bytes);
+  return (char *)obj;
+}
@@ -0,0 +1,30 @@
+#ifndef TIP_GC_H
+#define TIP_GC_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The shadow stack of GC root frames.  Code compiled with tipc -gc pushes
+ * a frame on entry to each function, holding the addresses of all of the
+ * function's stack slots, and pops it before returning.
+ */
+struct tip_gc_frame {
+  struct tip_gc_frame *prev;
+  int64_t nroots;
+  int64_t *roots[];
+};
+
+extern struct tip_gc_frame *_tip_gc_frames;
+
+// Allocate zeroed memory from the collected heap
+char *_tip_gc_alloc(int64_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -2,6 +2,10 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <inttypes.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
 
 /*
  * These are defined for each TIP program in the compiled code.
@@ -10,6 +14,127 @@ int64_t _tip_main();
 extern int64_t _tip_num_inputs;
 extern int64_t _tip_input_array[]; 
 
+/*
+ * Batch I/O mode.
+ *
+ * By default each input prompts and calls scanf and each output calls
+ * printf, which is what an interactive user wants but dominates the run
+ * time of programs that stream many values.  In batch mode input is read
+ * with large read calls and parsed by hand, output is formatted into a
+ * large buffer that is flushed when full, on exit and on error, and the
+ * input prompt is only printed when stdin is a terminal.
+ *
+ * Batch mode is selected by compiling this file with -DTIP_BATCH_IO, or
+ * at run time by setting the TIP_BATCH_IO environment variable to any
+ * value other than 0.
+ */
+#define TIP_IO_BUFSIZE (1 << 16)
+
+static int batch_io = -1;
+static int stdin_tty;
+
+static char in_buf[TIP_IO_BUFSIZE];
+static size_t in_pos, in_len;
+static int in_eof;
+
+static char out_buf[TIP_IO_BUFSIZE];
+static size_t out_len;
+
+static void flush_output() {
+  size_t written = 0;
+  while (written < out_len) {
+    ssize_t n = write(1, out_buf + written, out_len - written);
+    if (n <= 0) {
+      break;
+    }
+    written += n;
+  }
+  out_len = 0;
+}
+
+static int use_batch_io() {
+  if (batch_io < 0) {
+#ifdef TIP_BATCH_IO
+    batch_io = 1;
+#else
+    const char *mode = getenv("TIP_BATCH_IO");
+    batch_io = mode != NULL && *mode != '\0' && strcmp(mode, "0") != 0;
+#endif
+    if (batch_io) {
+      stdin_tty = isatty(0);
+      atexit(flush_output);
+    }
+  }
+  return batch_io;
+}
+
+static void write_str(const char *str) {
+  size_t len = strlen(str);
+  if (out_len + len > TIP_IO_BUFSIZE) {
+    flush_output();
+  }
+  memcpy(out_buf + out_len, str, len);
+  out_len += len;
+}
+
+static void write_int(int64_t x) {
+  // digits are produced in reverse, 20 digits plus a sign always fit
+  char digits[24];
+  int n = 0;
+  uint64_t u = x < 0 ? -(uint64_t)x : (uint64_t)x;
+  do {
+    digits[n++] = '0' + u % 10;
+    u /= 10;
+  } while (u != 0);
+  if (x < 0) {
+    digits[n++] = '-';
+  }
+
+  if (out_len + n > TIP_IO_BUFSIZE) {
+    flush_output();
+  }
+  while (n > 0) {
+    out_buf[out_len++] = digits[--n];
+  }
+}
+
+// Returns the next input character, or -1 at the end of input
+static int next_char() {
+  if (in_pos == in_len) {
+    if (in_eof) {
+      return -1;
+    }
+    ssize_t n = read(0, in_buf, TIP_IO_BUFSIZE);
+    if (n <= 0) {
+      in_eof = 1;
+      return -1;
+    }
+    in_pos = 0;
+    in_len = n;
+  }
+  return in_buf[in_pos++];
+}
+
+static int64_t read_int() {
+  int c = next_char();
+  while (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+    c = next_char();
+  }
+
+  int negative = 0;
+  if (c == '-' || c == '+') {
+    negative = (c == '-');
+    c = next_char();
+  }
+
+  uint64_t x = 0;
+  while (c >= '0' && c <= '9') {
+    x = x * 10 + (c - '0');
+    c = next_char();
+  }
+  return negative ? -(int64_t)x : (int64_t)x;
+}
+
 /* 
  * intrinsic functions for TIP IO expressions and statements
  *    x = input;
@@ -17,6 +142,14 @@ extern int64_t _tip_input_array[];
  *    error y;
  */
 int64_t _tip_input() {
+  if (use_batch_io()) {
+    if (stdin_tty) {
+      write_str("Enter input: ");
+      flush_output();
+    }
+    return read_int();
+  }
+
   int64_t x;
   printf("Enter input: ");
   scanf("%" SCNd64, &x);
@@ -24,23 +157,244 @@ int64_t _tip_input() {
 }
 
 void _tip_output(int64_t x) {
+  if (use_batch_io()) {
+    write_str("Program output: ");
+    write_int(x);
+    write_str("\n");
+    return;
+  }
+
   printf("Program output: %" PRId64 "\n", x); 
 }  
 
 void _tip_error(int64_t x) {
+  if (use_batch_io()) {
+    write_str("[error] Error: Execution error, code: ");
+    write_int(x);
+    write_str("\n");
+    flush_output();
+    exit(-1);
+  }
+
   printf("[error] Error: Execution error, code: %" PRId64 "\n", x); 
   exit(-1);
 }
 
+/*
+ * Heap allocation for TIP alloc expressions.
+ *
+ * The heap is a bump-pointer region of large chunks obtained from mmap.
+ * Compiled code allocates inline by bumping _tip_heap_ptr and checking it
+ * against _tip_heap_end, and only calls _tip_alloc when the current chunk
+ * is exhausted.  Memory is never freed.
+ */
+#define TIP_HEAP_CHUNK ((size_t)64 << 20)
+
+char *_tip_heap_ptr = NULL;
+char *_tip_heap_end = NULL;
+
+char *_tip_alloc(int64_t size) {
+  size_t len = size > TIP_HEAP_CHUNK ? (size_t)size : TIP_HEAP_CHUNK;
+  char *chunk = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (chunk == MAP_FAILED) {
+    if (use_batch_io()) {
+      flush_output();
+    }
+    printf("Error: out of memory\n");
+    exit(-1);
+  }
+
+  _tip_heap_ptr = chunk + size;
+  _tip_heap_end = chunk + len;
+  return chunk;
+}
+
 /*
  * If the compiled program has no "main" function then one is created
  * that calls this function.
  */
 void _tip_main_undefined() {
+  if (use_batch_io()) {
+    flush_output();
+  }
   printf("Error: missing main function\n"); 
   exit(-1);
 }
 
+/*
+ * Profiles for profile guided optimization.
+ *
+ * A program compiled with -fprofile-generate defines these, a counter for
+ * the entry of each function and for each edge of each branch, and a hash
+ * of its source.  When it exits, normally or through _tip_error, the
+ * counts are written to the file named by the TIP_PROFILE_FILE
+ * environment variable, by default "tip.profile", and added to the counts
+ * that are already there for the same source.
+ */
+extern int64_t _tip_prof_counters[] __attribute__((weak));
+extern const int64_t _tip_prof_num_counters __attribute__((weak));
+extern const int64_t _tip_prof_hash __attribute__((weak));
+
+static void write_profile() {
+  const char *path = getenv("TIP_PROFILE_FILE");
+  if (path == NULL || *path == '\0') {
+    path = "tip.profile";
+  }
+
+  // merge with the earlier runs of the same program
+  FILE *old = fopen(path, "r");
+  if (old != NULL) {
+    int64_t hash, num;
+    if (fscanf(old, "tip-profile %" SCNd64 " %" SCNd64, &hash, &num) == 2 &&
+        hash == _tip_prof_hash && num == _tip_prof_num_counters) {
+      for (int64_t i = 0; i < num; i++) {
+        int64_t count;
+        if (fscanf(old, "%" SCNd64, &count) != 1) {
+          break;
+        }
+        _tip_prof_counters[i] += count;
+      }
+    }
+    fclose(old);
+  }
+
+  FILE *out = fopen(path, "w");
+  if (out == NULL) {
+    fprintf(stderr, "Error: unable to write profile %s\n", path);
+    return;
+  }
+  fprintf(out, "tip-profile %" PRId64 " %" PRId64 "\n", _tip_prof_hash,
+          _tip_prof_num_counters);
+  for (int64_t i = 0; i < _tip_prof_num_counters; i++) {
+    fprintf(out, "%" PRId64 "\n", _tip_prof_counters[i]);
+  }
+  fclose(out);
+}
+
+/*
+ * Function profiler.
+ *
+ * A program compiled with -instrument defines the names and the number
+ * of its functions, and calls _tip_instr_enter with the index of each
+ * function it enters and _tip_instr_exit as the function returns.  These
+ * keep a stack of the active calls with the cycles at their entry and the
+ * cycles spent in their callees, from which the calls, the inclusive and
+ * the exclusive cycles of each function are accumulated.  Cycles in a
+ * recursive call are only included once, in its outermost call.  When the
+ * program exits, normally or through _tip_error, the calls still active
+ * are closed and a report sorted by exclusive cycles is printed to
+ * stderr.
+ */
+extern const int64_t _tip_instr_num_functions __attribute__((weak));
+extern const char *const _tip_instr_names[] __attribute__((weak));
+
+struct instr_function {
+  uint64_t calls;
+  uint64_t inclusive;
+  uint64_t exclusive;
+  // the number of active calls, above one for recursion
+  uint64_t active;
+};
+
+struct instr_call {
+  int64_t function;
+  uint64_t start;
+  uint64_t callees;
+};
+
+static struct instr_function *instr_functions = NULL;
+static struct instr_call *instr_stack = NULL;
+static size_t instr_depth = 0;
+static size_t instr_capacity = 0;
+
+static inline uint64_t read_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  uint32_t lo, hi;
+  __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((uint64_t)hi << 32) | lo;
+#elif defined(__aarch64__)
+  uint64_t ticks;
+  __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(ticks));
+  return ticks;
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+void _tip_instr_enter(int64_t function) {
+  if (instr_depth == instr_capacity) {
+    instr_capacity = instr_capacity == 0 ? 1024 : 2 * instr_capacity;
+    instr_stack = realloc(instr_stack, instr_capacity * sizeof(*instr_stack));
+    if (instr_stack == NULL) {
+      fprintf(stderr, "Error: out of memory for the profiler\n");
+      exit(-1);
+    }
+  }
+  struct instr_call *call = &instr_stack[instr_depth++];
+  call->function = function;
+  call->callees = 0;
+  instr_functions[function].calls++;
+  instr_functions[function].active++;
+  // read last so the bookkeeping is not counted
+  call->start = read_cycles();
+}
+
+void _tip_instr_exit() {
+  uint64_t now = read_cycles();
+  struct instr_call *call = &instr_stack[--instr_depth];
+  struct instr_function *f = &instr_functions[call->function];
+  uint64_t elapsed = now - call->start;
+  f->exclusive += elapsed - call->callees;
+  if (--f->active == 0) {
+    f->inclusive += elapsed;
+  }
+  if (instr_depth > 0) {
+    instr_stack[instr_depth - 1].callees += elapsed;
+  }
+}
+
+static int compare_exclusive(const void *x, const void *y) {
+  uint64_t ex = instr_functions[*(const int64_t *)x].exclusive;
+  uint64_t ey = instr_functions[*(const int64_t *)y].exclusive;
+  return ex < ey ? 1 : ex > ey ? -1 : 0;
+}
+
+static void report_functions() {
+  // the report follows the output of the program
+  fflush(stdout);
+  while (instr_depth > 0) {
+    _tip_instr_exit();
+  }
+
+  uint64_t total = 0;
+  int64_t *order = malloc(_tip_instr_num_functions * sizeof(*order));
+  if (order == NULL) {
+    return;
+  }
+  for (int64_t i = 0; i < _tip_instr_num_functions; i++) {
+    order[i] = i;
+    total += instr_functions[i].exclusive;
+  }
+  qsort(order, _tip_instr_num_functions, sizeof(*order), compare_exclusive);
+
+  fprintf(stderr, "%12s %16s %16s %7s  %s\n", "calls", "inclusive",
+          "exclusive", "%", "function");
+  for (int64_t i = 0; i < _tip_instr_num_functions; i++) {
+    struct instr_function *f = &instr_functions[order[i]];
+    if (f->calls == 0) {
+      continue;
+    }
+    fprintf(stderr, "%12" PRIu64 " %16" PRIu64 " %16" PRIu64 " %6.2f%%  %s\n",
+            f->calls, f->inclusive, f->exclusive,
+            total == 0 ? 0.0 : 100.0 * f->exclusive / total,
+            _tip_instr_names[order[i]]);
+  }
+  free(order);
+}
+
 /*
  * Set up the arguments to be read by the TIP "main" function.
  * The number of arguments is defined by the compiled TIP code
@@ -63,8 +417,22 @@ int main(int argc, char *argv[]) {
   for (size_t i=0; i < _tip_num_inputs; i++) {
     _tip_input_array[i] = strtoll(argv[i+1], &eptr, 10);
   }
+
+  if (&_tip_prof_num_counters != NULL) {
+    atexit(write_profile);
+  }
+
+  if (&_tip_instr_num_functions != NULL) {
+    instr_functions = calloc(_tip_instr_num_functions,
+                             sizeof(*instr_functions));
+    if (instr_functions == NULL) {
+      printf("Error: out of memory\n");
+      exit(-1);
+    }
+    atexit(report_functions);
+  }
   
-  printf("Program output: %" PRId64 "\n", _tip_main());
+  _tip_output(_tip_main());
 
   return 0;
 }
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tip_memo.h"
+
+/*
+ * The memo table of each function is direct mapped, so it is bounded and
+ * a lookup is a hash and a compare.  An entry holds whether it is set,
+ * the result and the arguments, and a store replaces whatever entry held
+ * the slot before.  The number of entries of each table is a power of
+ * two, MEMO_DEFAULT_ENTRIES unless it is set by the TIP_MEMO_ENTRIES
+ * environment variable, and a table is allocated on the first call of
+ * its function.
+ */
+#define MEMO_DEFAULT_ENTRIES ((size_t)1 << 14)
+
+struct memo_table {
+  size_t nargs;
+  int64_t *entries;
+};
+
+static struct memo_table *tables = NULL;
+static size_t num_tables = 0;
+static size_t num_entries = 0;
+
+static void out_of_memory() {
+  fprintf(stderr, "Error: out of memory\n");
+  exit(-1);
+}
+
+static size_t get_num_entries() {
+  if (num_entries == 0) {
+    const char *size = getenv("TIP_MEMO_ENTRIES");
+    size_t requested = size != NULL ? strtoull(size, NULL, 10) : 0;
+    if (requested == 0) {
+      requested = MEMO_DEFAULT_ENTRIES;
+    }
+    // round down to a power of two so the hash can be masked
+    num_entries = 1;
+    while (num_entries <= requested / 2) {
+      num_entries *= 2;
+    }
+  }
+  return num_entries;
+}
+
+static uint64_t hash_args(int64_t nargs, const int64_t *args) {
+  uint64_t h = (uint64_t)nargs;
+  for (int64_t i = 0; i < nargs; i++) {
+    h = (h ^ (uint64_t)args[i]) * 0x9e3779b97f4a7c15ull;
+    h ^= h >> 29;
+  }
+  return h;
+}
+
+// The entry for the arguments, which may hold other arguments
+static int64_t *find_entry(int64_t function, int64_t nargs,
+                           const int64_t *args) {
+  if ((size_t)function >= num_tables) {
+    size_t grown = num_tables == 0 ? 16 : num_tables;
+    while (grown <= (size_t)function) {
+      grown *= 2;
+    }
+    tables = realloc(tables, grown * sizeof(*tables));
+    if (tables == NULL) {
+      out_of_memory();
+    }
+    memset(tables + num_tables, 0, (grown - num_tables) * sizeof(*tables));
+    num_tables = grown;
+  }
+
+  struct memo_table *table = &tables[function];
+  if (table->entries == NULL) {
+    table->nargs = nargs;
+    table->entries = calloc(get_num_entries() * (nargs + 2), sizeof(int64_t));
+    if (table->entries == NULL) {
+      out_of_memory();
+    }
+  }
+  size_t slot = hash_args(nargs, args) & (get_num_entries() - 1);
+  return table->entries + slot * (table->nargs + 2);
+}
+
+int64_t _tip_memo_lookup(int64_t function, int64_t nargs, const int64_t *args,
+                         int64_t *result) {
+  int64_t *entry = find_entry(function, nargs, args);
+  if (entry[0] && memcmp(entry + 2, args, nargs * sizeof(int64_t)) == 0) {
+    *result = entry[1];
+    return 1;
+  }
+  return 0;
+}
+
+void _tip_memo_store(int64_t function, int64_t nargs, const int64_t *args,
+                     int64_t result) {
+  int64_t *entry = find_entry(function, nargs, args);
+  entry[0] = 1;
+  entry[1] = result;
+  memcpy(entry + 2, args, nargs * sizeof(int64_t));
+}
@@ -0,0 +1,28 @@
+#ifndef TIP_MEMO_H
+#define TIP_MEMO_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Memo tables for the pure functions of programs compiled with tipc
+ * -memoize.  Functions are identified by their index in the function
+ * table and their arguments, as integers, are the key.
+ */
+
+// Set *result and return 1 if the table holds a result for the arguments
+int64_t _tip_memo_lookup(int64_t function, int64_t nargs, const int64_t *args,
+                         int64_t *result);
+
+// Record the result for the arguments, replacing an entry if needed
+void _tip_memo_store(int64_t function, int64_t nargs, const int64_t *args,
+                     int64_t result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -3,235 +3,304 @@
 
 namespace TIPtree {
 
-static int ast_counter = 1;
-// mapping from function name to astnode id
-static std::map<std::string, int> fun2id;
-// mapping from variable name to astnode id
-static std::map<std::string, int> var2id;
+/*
+ * IdContext - the state of numbering the nodes of one Program
+ *
+ * Besides the next free id this holds the mappings from the symbol id of
+ * a function or variable name to the astnode id it is bound to, 0 when
+ * the symbol is unbound.  These are flat tables sized to the program's
+ * symbol table in Program::genId.
+ */
+class IdContext {
+public:
+    int counter = 1;
+    std::vector<int> fun2id;
+    std::vector<int> var2id;
+    // symbols bound in var2id by the function currently being visited
+    std::vector<int> scopeVars;
+
+    void bindVar(Symbol var, int id) {
+        if (var2id[var.id] == 0) {
+            scopeVars.push_back(var.id);
+        }
+        var2id[var.id] = id;
+    }
+
+    void clearVars() {
+        for (int var : scopeVars) {
+            var2id[var] = 0;
+        }
+        scopeVars.clear();
+    }
+};
+
+Symbol SymbolTable::intern(llvm::StringRef name) {
+    auto entry = Ids.insert(std::make_pair(name, (int)Names.size()));
+    if (entry.second) {
+        // the key stored in the map is the one copy of the identifier
+        Names.push_back(entry.first->getKey());
+    }
+    return get(entry.first->getValue());
+}
+
+Symbol SymbolTable::lookup(llvm::StringRef name) const {
+    auto entry = Ids.find(name);
+    if (entry == Ids.end()) {
+        return Symbol();
+    }
+    return get(entry->getValue());
+}
+
+Symbol SymbolTable::get(int id) const {
+    Symbol sym;
+    sym.id = id;
+    sym.name = Names[id];
+    return sym;
+}
+
+AstArena::~AstArena() {
+    // destroy in reverse order of construction, the slabs are freed after
+    for (auto it = Nodes.rbegin(); it != Nodes.rend(); ++it) {
+        (*it)->~AstNode();
+    }
+}
 
 int AstNode::getId() {
     return this->id;
 }
 
-void NumberExpr::genId() {
+void NumberExpr::genId(IdContext *ids) {
     if (this->id) {
         return;
     }
-    this->id = ast_counter++;
+    this->id = ids->counter++;
 }
 
-void VariableExpr::genId() {
+void VariableExpr::genId(IdContext *ids) {
     if (this->id) {
         return;
     }
-    if (var2id.find(NAME) != var2id.end()) {
-        this->id = var2id[NAME];
+    if (ids->var2id[NAME.id]) {
+        this->id = ids->var2id[NAME.id];
         return;
     }
-    if (fun2id.find(NAME) != fun2id.end()) {
-        this->id = fun2id[NAME];
+    if (ids->fun2id[NAME.id]) {
+        this->id = ids->fun2id[NAME.id];
         return;
     }
-    throw TIPTypeError("Undefined variable reference: "+NAME);
+    throw TIPTypeError([this]() {
+        return "Undefined variable reference: " + NAME.str();
+    }).locate(0, line, column);
 }
 
-void BinaryExpr::genId() {
+void BinaryExpr::genId(IdContext *ids) {
     if (this->id) {
         return;
     }
-    this->id = ast_counter++;
-    LHS->genId();
-    RHS->genId();
+    this->id = ids->counter++;
+    LHS->genId(ids);
+    RHS->genId(ids);
 }
 
-void FunAppExpr::genId() {
+void FunAppExpr::genId(IdContext *ids) {
     if (this->id) {
         return;
     }
-    this->id = ast_counter++;
+    this->id = ids->counter++;
     //no need to gen id for fun ptr
     for (auto const& actual : ACTUALS) {
-        actual->genId();
+        actual->genId(ids);
     }
-    this->FUN->genId();
+    this->FUN->genId(ids);
 }
 
-void InputExpr::genId() {
+void InputExpr::genId(IdContext *ids) {
     if (this->id) {
         return;
     }
-    this->id = ast_counter++;
+    this->id = ids->counter++;
 }
 
-void AllocExpr::genId() {
+void AllocExpr::genId(IdContext *ids) {
     if (this->id) {
         return;
     }
-    this->id = ast_counter++;
-    ARG->genId();
+    this->id = ids->counter++;
+    ARG->genId(ids);
 }
 
-void RefExpr::genId() {
+void RefExpr::genId(IdContext *ids) {
     if (this->id) {
         return;
     }
-    this->id = ast_counter++;
-    this->refId = var2id[NAME];
+    this->id = ids->counter++;
+    this->refId = ids->var2id[NAME.id];
 }
 
-void DeRefExpr::genId() {
+void DeRefExpr::genId(IdContext *ids) {
     if (this->id) {
         return;
     }
-    this->id = ast_counter++;
-    ARG->genId();
+    this->id = ids->counter++;
+    ARG->genId(ids);
 }
 
-void NullExpr::genId() {
+void NullExpr::genId(IdContext *ids) {
     if (this->id) {
         return;
     }
-    this->id = ast_counter++;
+    this->id = ids->counter++;
 }
 
-void FieldExpr::genId() {
+void FieldExpr::genId(IdContext *ids) {
     if (this->id) {
         return;
     }
-    this->id = ast_counter++;
+    this->id = ids->counter++;
+    INIT->genId(ids);
 }
 
-void RecordExpr::genId() {
+void RecordExpr::genId(IdContext *ids) {
     if (this->id) {
         return;
     }
-    this->id = ast_counter++;
+    this->id = ids->counter++;
+    for (auto const& field : FIELDS) {
+        field->genId(ids);
+    }
 }
 
-void AccessExpr::genId() {
+void AccessExpr::genId(IdContext *ids) {
     if (this->id) {
         return;
     }
-    this->id = ast_counter++;
+    this->id = ids->counter++;
+    RECORD->genId(ids);
 }
 
-void DeclStmt::genId() {
+void DeclStmt::genId(IdContext *ids) {
     if (this->id) {
         return;
     }
-    this->id = ast_counter++;
-    for (std::string var : VARS) {
-        var2id[var] = ast_counter++;
-        this->VAR_IDS.push_back(var2id[var]);
+    this->id = ids->counter++;
+    for (Symbol var : VARS) {
+        ids->bindVar(var, ids->counter++);
+        this->VAR_IDS.push_back(ids->var2id[var.id]);
     }
 }
 
-void BlockStmt::genId() {
+void BlockStmt::genId(IdContext *ids) {
     if (this->id) {
         return;
     }
-    this->id = ast_counter++;
+    this->id = ids->counter++;
     for (auto const& stmt : STMTS) {
-        stmt->genId();
+        stmt->genId(ids);
     }
 }
 
-void AssignStmt::genId() {
+void AssignStmt::genId(IdContext *ids) {
     if (this->id) {
         return;
     }
-    this->id = ast_counter++;
-    LHS->genId();
-    RHS->genId();
+    this->id = ids->counter++;
+    LHS->genId(ids);
+    RHS->genId(ids);
 }
 
-void WhileStmt::genId() {
+void WhileStmt::genId(IdContext *ids) {
     if (this->id) {
         return;
     }
-    this->id = ast_counter++;
-    COND->genId();
-    BODY->genId();
+    this->id = ids->counter++;
+    COND->genId(ids);
+    BODY->genId(ids);
 }
 
-void IfStmt::genId() {
+void IfStmt::genId(IdContext *ids) {
     if (this->id) {
         return;
     }
-    this->id = ast_counter++;
-    COND->genId();
-    THEN->genId();
+    this->id = ids->counter++;
+    COND->genId(ids);
+    THEN->genId(ids);
     if (ELSE) {
-        ELSE->genId();
+        ELSE->genId(ids);
     }
 }
 
-void OutputStmt::genId() {
+void OutputStmt::genId(IdContext *ids) {
     if (this->id) {
         return;
     }
-    this->id = ast_counter++;
-    ARG->genId();
+    this->id = ids->counter++;
+    ARG->genId(ids);
 }
 
-void ErrorStmt::genId() {
+void ErrorStmt::genId(IdContext *ids) {
     if (this->id) {
         return;
     }
-    this->id = ast_counter++;
-    ARG->genId();
+    this->id = ids->counter++;
+    ARG->genId(ids);
 }
 
-void ReturnStmt::genId() {
+void ReturnStmt::genId(IdContext *ids) {
     if (this->id) {
         return;
     }
-    this->id = ast_counter++;
-    ARG->genId();
+    this->id = ids->counter++;
+    ARG->genId(ids);
 }
 
-void Function::genId() {
+void Function::genId(IdContext *ids) {
     if (this->id) {
         return;
     }
-    if (fun2id.find(NAME) != fun2id.end()) {
-        this->id = fun2id[NAME];
+    if (ids->fun2id[NAME.id]) {
+        this->id = ids->fun2id[NAME.id];
     } else {
-        this->id = ast_counter++;
-        fun2id[NAME] = this->id;
+        this->id = ids->counter++;
+        ids->fun2id[NAME.id] = this->id;
     }
     //clear variable definitions
-    var2id.clear();
-    for (std::string param : FORMALS) {
-        var2id[param] = ast_counter++;
-        FORMAL_IDS.push_back(var2id[param]);
+    ids->clearVars();
+    for (Symbol param : FORMALS) {
+        ids->bindVar(param, ids->counter++);
+        FORMAL_IDS.push_back(ids->var2id[param.id]);
     }
     for (auto const &decl : DECLS) {
-        decl->genId();
+        decl->genId(ids);
     }
     for (auto const &stmt : BODY) {
-        stmt->genId();
+        stmt->genId(ids);
     }
 }
 
-void Program::genId() {
+void Program::genId(IdContext *ids) {
     if (this->id) {
         return;
     }
-    this->id = ast_counter++;
-    bool has_main = false;
+    this->id = ids->counter++;
+    ids->fun2id.assign(SYMBOLS->size(), 0);
+    ids->var2id.assign(SYMBOLS->size(), 0);
+    ids->scopeVars.clear();
     for (auto const& fun : FUNCTIONS) {
-        fun2id[fun->getName()] = ast_counter++;
-        if (fun->getName() == "main") {
-            has_main = true;
-        }
+        ids->fun2id[fun->getName().id] = ids->counter++;
     }
-    if (!has_main) {
+    int main_sym = SYMBOLS->lookup("main").id;
+    if (main_sym == -1 || !ids->fun2id[main_sym]) {
         throw TIPTypeError("No main function defined");
     }
     for (auto const& fun : FUNCTIONS) {
-        fun->genId();
+        fun->genId(ids);
     }
+    NUM_IDS = ids->counter;
+}
+
+void Program::genId() {
+    IdContext ids;
+    genId(&ids);
 }
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,107 @@
+#include "TIPcache.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+/*
+ * The identity of this build of tipc, the LLVM it uses and the size and
+ * modification time of the executable, which changes whenever tipc is
+ * rebuilt.
+ */
+static std::string getCompilerIdentity() {
+  std::string identity = "tipc LLVM " LLVM_VERSION_STRING;
+  std::string exe =
+      sys::fs::getMainExecutable(nullptr, (void *)&getCompilerIdentity);
+  sys::fs::file_status status;
+  if (!exe.empty() && !sys::fs::status(exe, status)) {
+    identity += " " + exe + " " + std::to_string(status.getSize()) + " " +
+                std::to_string(status.getLastModificationTime()
+                                   .time_since_epoch()
+                                   .count());
+  }
+  return identity;
+}
+
+std::string getCacheKey(StringRef source, StringRef options) {
+  static const std::string identity = getCompilerIdentity();
+
+  // the lengths keep the fields from running into each other
+  SHA1 hash;
+  for (StringRef field : {StringRef(identity), options, source}) {
+    hash.update(std::to_string(field.size()) + ":");
+    hash.update(field);
+  }
+  return toHex(hash.final(), true);
+}
+
+// The path of the file for the entry with the given suffix
+static std::string getEntryPath(const std::string &cacheDir,
+                                const std::string &key,
+                                const std::string &suffix) {
+  SmallString<128> path(cacheDir);
+  sys::path::append(path, key + suffix);
+  return path.str().str();
+}
+
+/*
+ * Create the file at path, holding contents or a copy of copyFrom when it
+ * is given, by writing a unique file and renaming it to path.
+ */
+static bool writeEntryFile(const std::string &path, StringRef contents,
+                           const std::string &copyFrom) {
+  SmallString<128> tmpPath;
+  int fd;
+  if (sys::fs::createUniqueFile(path + ".tmp%%%%%%", fd, tmpPath)) {
+    return false;
+  }
+  {
+    raw_fd_ostream os(fd, true);
+    os << contents;
+  }
+  if ((!copyFrom.empty() && sys::fs::copy_file(copyFrom, tmpPath)) ||
+      sys::fs::rename(tmpPath, path)) {
+    sys::fs::remove(tmpPath);
+    return false;
+  }
+  return true;
+}
+
+bool lookupCache(const std::string &cacheDir, const std::string &key,
+                 const std::string &suffix, const std::string &outputFile,
+                 std::string &output) {
+  /*
+   * The printed text is stored after the output file, so when there is
+   * text the output file is complete.
+   */
+  auto text = MemoryBuffer::getFile(getEntryPath(cacheDir, key, ".txt"));
+  if (!text) {
+    return false;
+  }
+  if (sys::fs::copy_file(getEntryPath(cacheDir, key, suffix), outputFile)) {
+    return false;
+  }
+  output = (*text)->getBuffer().str();
+  return true;
+}
+
+void storeCache(const std::string &cacheDir, const std::string &key,
+                const std::string &suffix, const std::string &outputFile,
+                const std::string &output) {
+  // failing to cache only means the file is compiled again next time
+  if (sys::fs::create_directories(cacheDir)) {
+    errs() << "tipc: unable to create the cache directory " << cacheDir
+           << "\n";
+    return;
+  }
+  if (writeEntryFile(getEntryPath(cacheDir, key, suffix), "", outputFile)) {
+    writeEntryFile(getEntryPath(cacheDir, key, ".txt"), output, "");
+  }
+}
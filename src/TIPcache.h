@@ -0,0 +1,33 @@
+#pragma once
+
+#include "llvm/ADT/StringRef.h"
+#include <string>
+
+/*
+ * On-disk cache of compiled TIP programs.
+ *
+ * Entries are content addressed, the key is a hash of the source bytes,
+ * the options that affect the generated code and the identity of the
+ * tipc executable, so that an entry is never reused by a different build
+ * of tipc.  Each entry is the file that tipc produced, a bitcode or an
+ * object file, with a suffix naming its kind, and the text that was
+ * printed while producing it.  Entries are written to a unique file and
+ * renamed into place, so concurrent tipc processes can share a directory.
+ */
+
+// The cache key for a source file compiled with the given options
+std::string getCacheKey(llvm::StringRef source, llvm::StringRef options);
+
+/*
+ * Copy the entry for the key with the given suffix to outputFile and
+ * return the text printed when it was produced.  Returns false if there
+ * is no such entry.
+ */
+bool lookupCache(const std::string &cacheDir, const std::string &key,
+                 const std::string &suffix, const std::string &outputFile,
+                 std::string &output);
+
+// Record outputFile, and the text printed, as the entry for the key
+void storeCache(const std::string &cacheDir, const std::string &key,
+                const std::string &suffix, const std::string &outputFile,
+                const std::string &output);
@@ -0,0 +1,132 @@
+#include "TIPemit.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/MC/SubtargetFeature.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Target/TargetOptions.h"
+#include <mutex>
+
+using namespace llvm;
+
+std::unique_ptr<TargetMachine>
+createTIPTargetMachine(const std::string &arch, const std::string &cpu,
+                       unsigned optLevel, std::string &error) {
+  // target machines are created by each of the compile threads
+  static std::once_flag initialized;
+  std::call_once(initialized, []() {
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+  });
+
+  Triple triple(sys::getDefaultTargetTriple());
+  const Target *target = TargetRegistry::lookupTarget(arch, triple, error);
+  if (target == nullptr) {
+    return nullptr;
+  }
+
+  // "native" selects the host cpu along with all of its extensions
+  std::string cpuName = cpu;
+  std::string features;
+  if (cpu == "native") {
+    cpuName = sys::getHostCPUName().str();
+    StringMap<bool> hostFeatures;
+    if (sys::getHostCPUFeatures(hostFeatures)) {
+      SubtargetFeatures featureSet;
+      for (auto &feature : hostFeatures) {
+        featureSet.AddFeature(feature.first(), feature.second);
+      }
+      features = featureSet.getString();
+    }
+  }
+
+  CodeGenOpt::Level level = CodeGenOpt::Default;
+  switch (optLevel) {
+  case 0:
+    level = CodeGenOpt::None;
+    break;
+  case 1:
+    level = CodeGenOpt::Less;
+    break;
+  case 3:
+    level = CodeGenOpt::Aggressive;
+    break;
+  }
+
+  TargetOptions options;
+  return std::unique_ptr<TargetMachine>(target->createTargetMachine(
+      triple.getTriple(), cpuName, features, options,
+      Optional<Reloc::Model>(Reloc::PIC_), None, level));
+}
+
+bool emitObjectFile(Module &theModule, TargetMachine &TM,
+                    const std::string &objectFile, std::string &error) {
+  std::error_code ec;
+  ToolOutputFile result(objectFile, ec, sys::fs::F_None);
+  if (ec) {
+    error = objectFile + ": " + ec.message();
+    return false;
+  }
+
+  legacy::PassManager codegenPasses;
+  if (TM.addPassesToEmitFile(codegenPasses, result.os(), nullptr,
+                             TargetMachine::CGFT_ObjectFile)) {
+    error = "the target cannot emit an object file";
+    return false;
+  }
+
+  codegenPasses.run(theModule);
+  result.keep();
+  return true;
+}
+
+// Run the system linker driver with the given arguments
+static bool runLinker(const std::vector<std::string> &linkArgs,
+                      const std::string &output, std::string &error) {
+  auto linker = sys::findProgramByName("cc");
+  if (!linker) {
+    error = "unable to find the system linker driver cc";
+    return false;
+  }
+
+  std::vector<StringRef> args;
+  args.push_back(*linker);
+  for (auto const &arg : linkArgs) {
+    args.push_back(arg);
+  }
+  args.push_back("-o");
+  args.push_back(output);
+
+  std::string message;
+  if (sys::ExecuteAndWait(*linker, args, None, {}, 0, 0, &message) != 0) {
+    error = "linking " + output + " failed";
+    if (!message.empty()) {
+      error += ": " + message;
+    }
+    return false;
+  }
+  return true;
+}
+
+bool linkExecutable(const std::vector<std::string> &objectFiles,
+                    const std::string &intrinsics,
+                    const std::string &executable, std::string &error) {
+  std::vector<std::string> args(1, "-static");
+  args.insert(args.end(), objectFiles.begin(), objectFiles.end());
+  if (!intrinsics.empty()) {
+    args.push_back(intrinsics);
+  }
+  return runLinker(args, executable, error);
+}
+
+bool linkRelocatable(const std::vector<std::string> &objectFiles,
+                     const std::string &objectFile, std::string &error) {
+  std::vector<std::string> args = {"-r", "-nostdlib"};
+  args.insert(args.end(), objectFiles.begin(), objectFiles.end());
+  return runLinker(args, objectFile, error);
+}
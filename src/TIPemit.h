@@ -0,0 +1,44 @@
+#pragma once
+
+#include "llvm/IR/Module.h"
+#include "llvm/Target/TargetMachine.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * Native code emission for compiled TIP programs.
+ *
+ * Rather than writing bitcode that clang must re-read and compile, tipc
+ * can compile the module itself through an LLVM TargetMachine for the
+ * host, or a selected architecture and cpu, and link the resulting object
+ * with a prebuilt intrinsics library.
+ */
+
+/*
+ * Create a target machine for the given architecture and cpu, where
+ * empty names select the host and a cpu of "native" selects the host cpu
+ * and its features.  Returns nullptr, with the reason in error, on
+ * failure.
+ */
+std::unique_ptr<llvm::TargetMachine>
+createTIPTargetMachine(const std::string &arch, const std::string &cpu,
+                       unsigned optLevel, std::string &error);
+
+// Emit the module as an object file, returns false and sets error on failure
+bool emitObjectFile(llvm::Module &theModule, llvm::TargetMachine &TM,
+                    const std::string &objectFile, std::string &error);
+
+/*
+ * Link object files with the intrinsics library into a statically
+ * linked executable using the system linker driver, returns false and
+ * sets error on failure.  Objects that already hold the intrinsics are
+ * linked with an empty intrinsics library.
+ */
+bool linkExecutable(const std::vector<std::string> &objectFiles,
+                    const std::string &intrinsics,
+                    const std::string &executable, std::string &error);
+
+// Combine object files into a single relocatable object file
+bool linkRelocatable(const std::vector<std::string> &objectFiles,
+                     const std::string &objectFile, std::string &error);
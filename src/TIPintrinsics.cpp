@@ -0,0 +1,69 @@
+#include "TIPintrinsics.h"
+
+#include "llvm/ADT/Triple.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Transforms/IPO/Internalize.h"
+
+using namespace llvm;
+
+#ifdef TIP_INTRINSICS_BITCODE
+// Generated from the intrinsics by the build
+extern const unsigned char tipIntrinsicsBitcode[];
+extern const size_t tipIntrinsicsBitcodeSize;
+
+bool hasIntrinsicsBitcode() { return true; }
+
+bool linkIntrinsics(Module &theModule, std::string &error) {
+  StringRef bitcode(reinterpret_cast<const char *>(tipIntrinsicsBitcode),
+                    tipIntrinsicsBitcodeSize);
+  auto intrinsics = parseBitcodeFile(
+      MemoryBufferRef(bitcode, "tip_intrinsics.bc"), theModule.getContext());
+  if (!intrinsics) {
+    error = "unable to read the intrinsics: " +
+            toString(intrinsics.takeError());
+    return false;
+  }
+
+  // a module without a target takes the target of the intrinsics
+  if (!theModule.getTargetTriple().empty()) {
+    Triple target(theModule.getTargetTriple());
+    Triple built((*intrinsics)->getTargetTriple());
+    if (target.getArch() != built.getArch()) {
+      error = "the intrinsics are built for " + built.str() +
+              " rather than " + target.str();
+      return false;
+    }
+    (*intrinsics)->setTargetTriple(theModule.getTargetTriple());
+    (*intrinsics)->setDataLayout(theModule.getDataLayout());
+  }
+
+  if (Linker::linkModules(theModule, std::move(*intrinsics))) {
+    error = "unable to link the intrinsics";
+    return false;
+  }
+
+  // the definitions replace the declarations and their attributes
+  for (StringRef name : {"_tip_error", "_tip_main_undefined"}) {
+    if (auto *F = theModule.getFunction(name)) {
+      F->addFnAttr(Attribute::NoReturn);
+      F->addFnAttr(Attribute::Cold);
+    }
+  }
+
+  internalizeModule(theModule, [](const GlobalValue &GV) {
+    return GV.getName() == "main";
+  });
+  return true;
+}
+#else
+// The build found no clang and llvm-link of the version of LLVM
+bool hasIntrinsicsBitcode() { return false; }
+
+bool linkIntrinsics(Module &theModule, std::string &error) {
+  error = "the intrinsics bitcode was not built into tipc";
+  return false;
+}
+#endif
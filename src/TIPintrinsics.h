@@ -0,0 +1,29 @@
+#pragma once
+
+#include "llvm/IR/Module.h"
+#include <string>
+
+/*
+ * The intrinsics as bitcode, embedded in tipc by the build.
+ *
+ * Calls of the intrinsics are normally opaque to the optimizer, which
+ * only sees their declarations and their attributes.  Linking the bitcode
+ * of the intrinsics, along with their main and the garbage collector,
+ * into the module before it is optimized makes it the whole program: the
+ * small intrinsics can be inlined into the loops that call them and
+ * everything but main is internalized.  Such a module is linked without
+ * the intrinsics library.
+ */
+
+/*
+ * Whether the build embedded the intrinsics, which needs the clang and
+ * llvm-link of the version of LLVM that tipc is built with.
+ */
+bool hasIntrinsicsBitcode();
+
+/*
+ * Link the intrinsics into the module, whose target, if it is set, must
+ * be the architecture they were built for.  Returns false with the reason
+ * in error on failure.
+ */
+bool linkIntrinsics(llvm::Module &theModule, std::string &error);
@@ -0,0 +1,231 @@
+#include "TIPjit.h"
+#include "tip_gc.h"
+#include "tip_memo.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/JITSymbol.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
+#include "llvm/ExecutionEngine/Orc/LambdaResolver.h"
+#include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
+#include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Mangler.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace llvm;
+using namespace llvm::orc;
+
+/*
+ * In-process implementations of the intrinsics that tip_intrinsics.c
+ * provides to statically linked TIP programs.  They must behave the same
+ * way so that running a program with --run is indistinguishable from
+ * running the linked binary.
+ */
+static int64_t jitInput() {
+  int64_t x;
+  printf("Enter input: ");
+  if (scanf("%" SCNd64, &x) != 1) {
+    x = 0;
+  }
+  return x;
+}
+
+static void jitOutput(int64_t x) { printf("Program output: %" PRId64 "\n", x); }
+
+static void jitError(int64_t x) {
+  printf("[error] Error: Execution error, code: %" PRId64 "\n", x);
+  fflush(stdout);
+  exit(-1);
+}
+
+static void jitMainUndefined() {
+  printf("Error: missing main function\n");
+  fflush(stdout);
+  exit(-1);
+}
+
+/*
+ * The heap region that compiled code bumps through, refilled from large
+ * chunks like the mmap based region of the intrinsics.
+ */
+static char *jitHeapPtr = nullptr;
+static char *jitHeapEnd = nullptr;
+
+static char *jitAlloc(int64_t size) {
+  const int64_t chunkSize = int64_t(64) << 20;
+  int64_t len = size > chunkSize ? size : chunkSize;
+  char *chunk = static_cast<char *>(calloc(len, 1));
+  if (chunk == nullptr) {
+    printf("Error: out of memory\n");
+    fflush(stdout);
+    exit(-1);
+  }
+  jitHeapPtr = chunk + size;
+  jitHeapEnd = chunk + len;
+  return chunk;
+}
+
+namespace {
+
+/*
+ * TIPjit - a minimal ORC JIT
+ *
+ * This follows the structure of the KaleidoscopeJIT from the LLVM
+ * tutorial.  Symbols are resolved first against the TIP intrinsics bound
+ * above, then against the modules added to the JIT and finally against
+ * the host process, e.g., for malloc.
+ */
+class TIPjit {
+  using ObjLayerT = RTDyldObjectLinkingLayer;
+  using CompileLayerT = IRCompileLayer<ObjLayerT, SimpleCompiler>;
+
+  ExecutionSession ES;
+  std::shared_ptr<SymbolResolver> Resolver;
+  std::unique_ptr<TargetMachine> TM;
+  const DataLayout DL;
+  ObjLayerT ObjectLayer;
+  CompileLayerT CompileLayer;
+  std::vector<VModuleKey> ModuleKeys;
+  StringMap<JITTargetAddress> Intrinsics;
+
+public:
+  TIPjit()
+      : Resolver(createLegacyLookupResolver(
+            ES,
+            [this](const std::string &Name) {
+              return findMangledSymbol(Name);
+            },
+            [](Error Err) { cantFail(std::move(Err), "lookupFlags failed"); })),
+        TM(EngineBuilder().selectTarget()), DL(TM->createDataLayout()),
+        ObjectLayer(ES,
+                    [this](VModuleKey) {
+                      return ObjLayerT::Resources{
+                          std::make_shared<SectionMemoryManager>(), Resolver};
+                    }),
+        CompileLayer(ObjectLayer, SimpleCompiler(*TM)) {
+    llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+  }
+
+  TargetMachine &getTargetMachine() { return *TM; }
+
+  // Bind an unmangled symbol name to an in-process definition
+  void bind(const std::string &Name, void *Addr) {
+    Intrinsics[mangle(Name)] = static_cast<JITTargetAddress>(
+        reinterpret_cast<uintptr_t>(Addr));
+  }
+
+  VModuleKey addModule(std::unique_ptr<Module> M) {
+    auto K = ES.allocateVModule();
+    cantFail(CompileLayer.addModule(K, std::move(M)));
+    ModuleKeys.push_back(K);
+    return K;
+  }
+
+  JITSymbol findSymbol(const std::string Name) {
+    return findMangledSymbol(mangle(Name));
+  }
+
+private:
+  std::string mangle(const std::string &Name) {
+    std::string MangledName;
+    {
+      raw_string_ostream MangledNameStream(MangledName);
+      Mangler::getNameWithPrefix(MangledNameStream, Name, DL);
+    }
+    return MangledName;
+  }
+
+  JITSymbol findMangledSymbol(const std::string &Name) {
+    auto intrinsic = Intrinsics.find(Name);
+    if (intrinsic != Intrinsics.end()) {
+      return JITSymbol(intrinsic->second, JITSymbolFlags::Exported);
+    }
+
+    // Search modules in reverse order: from last added to first added.
+    for (auto H : make_range(ModuleKeys.rbegin(), ModuleKeys.rend())) {
+      if (auto Sym = CompileLayer.findSymbolIn(H, Name, true)) {
+        return Sym;
+      }
+    }
+
+    // If we can't find the symbol in the JIT, try looking in the host process.
+    if (auto SymAddr = RTDyldMemoryManager::getSymbolAddressInProcess(Name)) {
+      return JITSymbol(SymAddr, JITSymbolFlags::Exported);
+    }
+
+    return nullptr;
+  }
+};
+
+} // namespace
+
+// Resolve a symbol of the JIT'd program to its address, 0 if it is missing
+static uintptr_t getAddress(TIPjit &jit, const std::string &Name) {
+  auto sym = jit.findSymbol(Name);
+  if (!sym) {
+    return 0;
+  }
+  return static_cast<uintptr_t>(cantFail(sym.getAddress()));
+}
+
+int runTIPProgram(std::unique_ptr<Module> theModule,
+                  const std::vector<std::string> &args) {
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+
+  TIPjit jit;
+  jit.bind("_tip_input", reinterpret_cast<void *>(&jitInput));
+  jit.bind("_tip_output", reinterpret_cast<void *>(&jitOutput));
+  jit.bind("_tip_error", reinterpret_cast<void *>(&jitError));
+  jit.bind("_tip_main_undefined", reinterpret_cast<void *>(&jitMainUndefined));
+  jit.bind("_tip_alloc", reinterpret_cast<void *>(&jitAlloc));
+  jit.bind("_tip_heap_ptr", reinterpret_cast<void *>(&jitHeapPtr));
+  jit.bind("_tip_heap_end", reinterpret_cast<void *>(&jitHeapEnd));
+  jit.bind("_tip_gc_alloc", reinterpret_cast<void *>(&_tip_gc_alloc));
+  jit.bind("_tip_gc_frames", reinterpret_cast<void *>(&_tip_gc_frames));
+  jit.bind("_tip_memo_lookup", reinterpret_cast<void *>(&_tip_memo_lookup));
+  jit.bind("_tip_memo_store", reinterpret_cast<void *>(&_tip_memo_store));
+
+  theModule->setDataLayout(jit.getTargetMachine().createDataLayout());
+  jit.addModule(std::move(theModule));
+
+  /*
+   * The argument count and array are defined by the compiled program,
+   * they are filled in here just as the main() of the intrinsics does.
+   */
+  auto *numInputs =
+      reinterpret_cast<int64_t *>(getAddress(jit, "_tip_num_inputs"));
+  auto *inputArray =
+      reinterpret_cast<int64_t *>(getAddress(jit, "_tip_input_array"));
+  auto *tipMain =
+      reinterpret_cast<int64_t (*)()>(getAddress(jit, "_tip_main"));
+  if (numInputs == nullptr || tipMain == nullptr) {
+    errs() << "tipc: unable to JIT the program\n";
+    return -1;
+  }
+
+  // Throw an error if the wrong number of arguments are passed
+  if ((int64_t)args.size() != *numInputs) {
+    printf("expected %" PRId64 " integer arguments\n", *numInputs);
+    return -1;
+  }
+
+  for (size_t i = 0; i < args.size(); i++) {
+    inputArray[i] = strtoll(args[i].c_str(), nullptr, 10);
+  }
+
+  printf("Program output: %" PRId64 "\n", tipMain());
+  fflush(stdout);
+
+  return 0;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "llvm/IR/Module.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * In-process execution of compiled TIP programs.
+ *
+ * The module produced by Program::codegen is compiled with an ORC JIT
+ * and its "_tip_main" is called directly, with the TIP IO intrinsics bound
+ * to implementations in tipc itself.  This avoids writing the bitcode,
+ * linking it with the intrinsics and running the resulting binary.
+ *
+ * The arguments are the integer arguments of the TIP main function and
+ * the result is the exit status of the program.
+ */
+int runTIPProgram(std::unique_ptr<llvm::Module> theModule,
+                  const std::vector<std::string> &args);
@@ -0,0 +1,353 @@
+#include "TIPtree.h"
+#include "UnionFindSolver.h"
+
+namespace TIPtree {
+
+/*
+ * PointsToContext - the state of a Steensgaard style points-to analysis
+ *
+ * Locations are a variable, identified by the id of its declaration, the
+ * cell of an alloc or a record, identified by the id of the expression,
+ * and the return value of a function, identified by the id of the
+ * function.  Locations are partitioned into classes with the union-find
+ * forest of a UnionFindSolver, in which no node is ever bound to a type,
+ * and each class has a class of contents: the locations that the values
+ * stored in it may point to.  Whenever two values may be equal the
+ * classes they point to are joined, and so are the contents of the
+ * classes, so an access through a pointer may only touch the locations
+ * of one class.  Joining is unconditional, even for values that are only
+ * integers, which is less precise than Steensgaard's analysis but takes
+ * linear time.  Ids at and above the number of nodes are fresh classes.
+ *
+ * The arguments and results of calls of unknown functions are joined in
+ * the indirect locations, which are joined with the formals and return
+ * values of every function that is used as a value.
+ *
+ * A location escapes from the call that creates it when its class can be
+ * reached, through the contents of classes, from the arguments or from a
+ * result of any call.
+ */
+class PointsToContext {
+    UnionFindSolver classes;
+    std::vector<int> contents;
+    // pairs of classes waiting to be joined
+    std::vector<std::pair<int, int>> pending;
+    std::vector<int> indirectArgs;
+    int indirectRet = -1;
+public:
+    // the Function of each function id, nullptr for the other ids
+    std::vector<Function *> functions;
+    // the functions that are used as values, by id
+    std::vector<int> takenFunctions;
+    // the id of the function being visited
+    int function = 0;
+    // the class of the locations accessed by each node, or -1
+    std::vector<int> accessed;
+    // the number of loops around the node being visited
+    int loopDepth = 0;
+    // the allocations that are not in a loop, by id
+    std::vector<int> onceAllocs;
+
+    PointsToContext(int numNodes)
+        : contents(numNodes, -1), functions(numNodes, nullptr),
+          accessed(numNodes, -1) {}
+
+    int fresh() {
+        contents.push_back(-1);
+        return contents.size() - 1;
+    }
+
+    int find(int loc) {
+        return classes.findRoot(loc);
+    }
+
+    // join the classes and then their contents, returns the first
+    int join(int locx, int locy) {
+        pending.emplace_back(locx, locy);
+        while (!pending.empty()) {
+            int rootx = find(pending.back().first);
+            int rooty = find(pending.back().second);
+            pending.pop_back();
+            if (rootx == rooty) {
+                continue;
+            }
+            int contentsx = contents[rootx];
+            int contentsy = contents[rooty];
+            int root = classes.unionNodes(rootx, rooty);
+            contents[root] = contentsx != -1 ? contentsx : contentsy;
+            if (contentsx != -1 && contentsy != -1) {
+                pending.emplace_back(contentsx, contentsy);
+            }
+        }
+        return locx;
+    }
+
+    // the class of the locations that the values in the class point to
+    int contentsOf(int loc) {
+        int root = find(loc);
+        if (contents[root] == -1) {
+            int loc_contents = fresh();
+            contents[root] = loc_contents;
+        }
+        return contents[root];
+    }
+
+    int indirectArg(size_t i) {
+        while (indirectArgs.size() <= i) {
+            indirectArgs.push_back(fresh());
+        }
+        return indirectArgs[i];
+    }
+
+    int indirectResult() {
+        if (indirectRet == -1) {
+            indirectRet = fresh();
+        }
+        return indirectRet;
+    }
+
+    void access(int node_id, int loc) {
+        accessed[node_id] = loc;
+    }
+
+    // the classes that escape, indexed by the root of the class
+    std::vector<bool> findEscaping() {
+        std::vector<int> escaping;
+        for (Function *fun : functions) {
+            if (fun != nullptr) {
+                for (int formal : fun->getFormalIds()) {
+                    escaping.push_back(contentsOf(formal));
+                }
+                escaping.push_back(contentsOf(fun->getId()));
+            }
+        }
+        for (int arg : indirectArgs) {
+            escaping.push_back(contentsOf(arg));
+        }
+        if (indirectRet != -1) {
+            escaping.push_back(contentsOf(indirectRet));
+        }
+
+        std::vector<bool> escapes(contents.size(), false);
+        while (!escaping.empty()) {
+            int root = find(escaping.back());
+            escaping.pop_back();
+            if (!escapes[root]) {
+                escapes[root] = true;
+                if (contents[root] != -1) {
+                    escaping.push_back(contents[root]);
+                }
+            }
+        }
+        return escapes;
+    }
+};
+
+int NumberExpr::findPointsTo(PointsToContext *ctx) {
+    return ctx->fresh();
+}
+
+// a variable has the value stored in it, a function name is taken
+int VariableExpr::findPointsTo(PointsToContext *ctx) {
+    if (ctx->functions[getId()] != nullptr) {
+        ctx->takenFunctions.push_back(getId());
+        return ctx->fresh();
+    }
+    return ctx->contentsOf(getId());
+}
+
+// without types pointers can be offset, so arithmetic keeps the pointers
+int BinaryExpr::findPointsTo(PointsToContext *ctx) {
+    int lhs = LHS->findPointsTo(ctx);
+    int rhs = RHS->findPointsTo(ctx);
+    if (OP == OpGt || OP == OpEq) {
+        return ctx->fresh();
+    }
+    return ctx->join(lhs, rhs);
+}
+
+int FunAppExpr::findPointsTo(PointsToContext *ctx) {
+    //a call by name with the right number of arguments is a direct call
+    auto *var = llvm::dyn_cast<VariableExpr>(FUN);
+    Function *callee = var != nullptr ? ctx->functions[var->getId()] : nullptr;
+    if (callee != nullptr && callee->getFormalIds().size() == ACTUALS.size()) {
+        for (size_t i = 0; i < ACTUALS.size(); i++) {
+            ctx->join(ctx->contentsOf(callee->getFormalIds()[i]),
+                      ACTUALS[i]->findPointsTo(ctx));
+        }
+        return ctx->contentsOf(callee->getId());
+    }
+
+    FUN->findPointsTo(ctx);
+    for (size_t i = 0; i < ACTUALS.size(); i++) {
+        ctx->join(ctx->contentsOf(ctx->indirectArg(i)),
+                  ACTUALS[i]->findPointsTo(ctx));
+    }
+    return ctx->contentsOf(ctx->indirectResult());
+}
+
+int InputExpr::findPointsTo(PointsToContext *ctx) {
+    return ctx->fresh();
+}
+
+int AllocExpr::findPointsTo(PointsToContext *ctx) {
+    if (ctx->loopDepth == 0) {
+        ctx->onceAllocs.push_back(getId());
+    }
+    ctx->join(ctx->contentsOf(getId()), ARG->findPointsTo(ctx));
+    ctx->access(getId(), getId());
+    return getId();
+}
+
+//the accesses of a variable whose address is taken are in its class
+int RefExpr::findPointsTo(PointsToContext *ctx) {
+    ctx->access(refId, refId);
+    return refId;
+}
+
+int DeRefExpr::findPointsTo(PointsToContext *ctx) {
+    int ptr = ARG->findPointsTo(ctx);
+    ctx->access(getId(), ptr);
+    return ctx->contentsOf(ptr);
+}
+
+int NullExpr::findPointsTo(PointsToContext *ctx) {
+    return ctx->fresh();
+}
+
+int FieldExpr::findPointsTo(PointsToContext *ctx) {
+    return INIT->findPointsTo(ctx);
+}
+
+//the fields of a record are not told apart
+int RecordExpr::findPointsTo(PointsToContext *ctx) {
+    for (auto const& field : FIELDS) {
+        ctx->join(ctx->contentsOf(getId()), field->findPointsTo(ctx));
+    }
+    ctx->access(getId(), getId());
+    return getId();
+}
+
+int AccessExpr::findPointsTo(PointsToContext *ctx) {
+    int record = RECORD->findPointsTo(ctx);
+    ctx->access(getId(), record);
+    return ctx->contentsOf(record);
+}
+
+int DeclStmt::findPointsTo(PointsToContext *ctx) {
+    return -1;
+}
+
+int BlockStmt::findPointsTo(PointsToContext *ctx) {
+    for (auto const& stmt : STMTS) {
+        stmt->findPointsTo(ctx);
+    }
+    return -1;
+}
+
+//the left side is a variable or a dereference, so its value is a location
+int AssignStmt::findPointsTo(PointsToContext *ctx) {
+    ctx->join(LHS->findPointsTo(ctx), RHS->findPointsTo(ctx));
+    return -1;
+}
+
+int WhileStmt::findPointsTo(PointsToContext *ctx) {
+    ctx->loopDepth++;
+    COND->findPointsTo(ctx);
+    BODY->findPointsTo(ctx);
+    ctx->loopDepth--;
+    return -1;
+}
+
+int IfStmt::findPointsTo(PointsToContext *ctx) {
+    COND->findPointsTo(ctx);
+    THEN->findPointsTo(ctx);
+    if (ELSE) {
+        ELSE->findPointsTo(ctx);
+    }
+    return -1;
+}
+
+int OutputStmt::findPointsTo(PointsToContext *ctx) {
+    ARG->findPointsTo(ctx);
+    return -1;
+}
+
+int ErrorStmt::findPointsTo(PointsToContext *ctx) {
+    ARG->findPointsTo(ctx);
+    return -1;
+}
+
+int ReturnStmt::findPointsTo(PointsToContext *ctx) {
+    ctx->join(ctx->contentsOf(ctx->function), ARG->findPointsTo(ctx));
+    return -1;
+}
+
+void Function::findPointsTo(PointsToContext *ctx) {
+    ctx->function = getId();
+    for (auto const &stmt : BODY) {
+        stmt->findPointsTo(ctx);
+    }
+}
+
+void Program::findPointsTo(PointsToContext *ctx) {
+    for (auto const& fun : FUNCTIONS) {
+        ctx->functions[fun->getId()] = fun;
+    }
+    for (auto const& fun : FUNCTIONS) {
+        fun->findPointsTo(ctx);
+    }
+
+    //every function used as a value may be called by any indirect call
+    for (int id : ctx->takenFunctions) {
+        Function *fun = ctx->functions[id];
+        for (size_t i = 0; i < fun->getFormalIds().size(); i++) {
+            ctx->join(ctx->contentsOf(fun->getFormalIds()[i]),
+                      ctx->contentsOf(ctx->indirectArg(i)));
+        }
+        ctx->join(ctx->contentsOf(id), ctx->contentsOf(ctx->indirectResult()));
+    }
+}
+
+std::vector<int> Program::findAliasClasses() {
+    PointsToContext ctx(NUM_IDS);
+    findPointsTo(&ctx);
+
+    //number the classes that are accessed densely
+    std::vector<int> aliasClasses(NUM_IDS, -1);
+    std::vector<int> number(ctx.accessed.size(), -1);
+    int numClasses = 0;
+    for (int id = 0; id < NUM_IDS; id++) {
+        if (ctx.accessed[id] == -1) {
+            continue;
+        }
+        int root = ctx.find(ctx.accessed[id]);
+        if (root >= (int)number.size()) {
+            number.resize(root + 1, -1);
+        }
+        if (number[root] == -1) {
+            number[root] = numClasses++;
+        }
+        aliasClasses[id] = number[root];
+    }
+    return aliasClasses;
+}
+
+/*
+ * A cell that is allocated at most once by each call of its function,
+ * outside of any loop, and that does not escape the call, cannot be
+ * referred to once the call returns.
+ */
+std::vector<bool> Program::findStackAllocs() {
+    PointsToContext ctx(NUM_IDS);
+    findPointsTo(&ctx);
+
+    std::vector<bool> escapes = ctx.findEscaping();
+    std::vector<bool> stackAllocs(NUM_IDS, false);
+    for (int id : ctx.onceAllocs) {
+        stackAllocs[id] = !escapes[ctx.find(id)];
+    }
+    return stackAllocs;
+}
+
+}
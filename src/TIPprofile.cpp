@@ -0,0 +1,45 @@
+#include "TIPprofile.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+using namespace llvm;
+
+uint64_t getProfileHash(StringRef source) { return MD5Hash(source); }
+
+bool readProfile(const std::string &file, TIPprofile &profile,
+                 std::string &error) {
+  auto buffer = MemoryBuffer::getFile(file);
+  if (!buffer) {
+    error = "unable to read profile " + file + ": " +
+            buffer.getError().message();
+    return false;
+  }
+
+  SmallVector<StringRef, 0> fields;
+  SplitString((*buffer)->getBuffer(), fields);
+
+  // the intrinsics write the hash as a signed integer
+  int64_t hash;
+  uint64_t numCounters;
+  if (fields.size() < 3 || fields[0] != "tip-profile" ||
+      fields[1].getAsInteger(10, hash) ||
+      fields[2].getAsInteger(10, numCounters) ||
+      numCounters != fields.size() - 3) {
+    error = file + " is not a TIP profile";
+    return false;
+  }
+
+  profile.mode = TIPprofile::Use;
+  profile.hash = hash;
+  profile.counts.assign(numCounters, 0);
+  for (uint64_t c = 0; c < numCounters; c++) {
+    if (fields[c + 3].getAsInteger(10, profile.counts[c])) {
+      error = file + " has an invalid count " + fields[c + 3].str();
+      return false;
+    }
+  }
+  return true;
+}
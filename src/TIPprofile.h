@@ -0,0 +1,34 @@
+#pragma once
+
+#include "llvm/ADT/StringRef.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Profiles for profile guided optimization.
+ *
+ * A program compiled with -fprofile-generate counts the entries of each
+ * function and the edges taken out of each if and while statement.  The
+ * counters are numbered in the order that code generation creates them,
+ * so a profile only applies to the source it was collected from, which
+ * is identified by a hash.  The intrinsics write the counts as text, a
+ * header "tip-profile <hash> <counters>" followed by one count per line.
+ */
+struct TIPprofile {
+  enum Mode { None, Generate, Use };
+  Mode mode = None;
+  uint64_t hash = 0;
+  // the counts of a profile being used, indexed by counter
+  std::vector<uint64_t> counts;
+};
+
+// The hash that identifies the source of a profile
+uint64_t getProfileHash(llvm::StringRef source);
+
+/*
+ * Read the profile in file for use, returns false with the reason in
+ * error if it cannot be read.
+ */
+bool readProfile(const std::string &file, TIPprofile &profile,
+                 std::string &error);
@@ -0,0 +1,191 @@
+#include "TIPtree.h"
+
+namespace TIPtree {
+
+/*
+ * EffectContext - the state of finding the side effects of one function
+ *
+ * A function is impure if it performs input, output or an error, touches
+ * the heap, takes the address of a variable, or calls a function that is
+ * not known.  Calls of the other functions of the program are recorded
+ * rather than followed, and Program::findPureFunctions propagates their
+ * impurity to their callers once every function has been visited.  The
+ * tables are indexed by symbol id.
+ */
+class EffectContext {
+public:
+    std::vector<bool> isFunction;
+    // the formals and locals of the function being visited
+    std::vector<bool> isLocal;
+    std::vector<int> locals;
+    bool impure = false;
+    // the functions called by name, by symbol id
+    std::vector<int> callees;
+
+    void bindLocal(Symbol var) {
+        if (!isLocal[var.id]) {
+            isLocal[var.id] = true;
+            locals.push_back(var.id);
+        }
+    }
+
+    void clearLocals() {
+        for (int var : locals) {
+            isLocal[var] = false;
+        }
+        locals.clear();
+    }
+};
+
+void NumberExpr::findEffects(EffectContext *ctx) {}
+
+// reading a variable, or the index of a function, has no effect
+void VariableExpr::findEffects(EffectContext *ctx) {}
+
+void BinaryExpr::findEffects(EffectContext *ctx) {
+    LHS->findEffects(ctx);
+    RHS->findEffects(ctx);
+}
+
+void FunAppExpr::findEffects(EffectContext *ctx) {
+    //only calls of a function by its name have a known callee
+    auto *var = llvm::dyn_cast<VariableExpr>(FUN);
+    int sym = var != nullptr ? var->getSymbol().id : -1;
+    if (sym != -1 && ctx->isFunction[sym] && !ctx->isLocal[sym]) {
+        ctx->callees.push_back(sym);
+    } else {
+        ctx->impure = true;
+    }
+    for (auto const& actual : ACTUALS) {
+        actual->findEffects(ctx);
+    }
+}
+
+void InputExpr::findEffects(EffectContext *ctx) {
+    ctx->impure = true;
+}
+
+void AllocExpr::findEffects(EffectContext *ctx) {
+    ctx->impure = true;
+}
+
+void RefExpr::findEffects(EffectContext *ctx) {
+    ctx->impure = true;
+}
+
+void DeRefExpr::findEffects(EffectContext *ctx) {
+    ctx->impure = true;
+}
+
+void NullExpr::findEffects(EffectContext *ctx) {}
+
+void FieldExpr::findEffects(EffectContext *ctx) {
+    INIT->findEffects(ctx);
+}
+
+//records are allocated on the heap
+void RecordExpr::findEffects(EffectContext *ctx) {
+    ctx->impure = true;
+}
+
+void AccessExpr::findEffects(EffectContext *ctx) {
+    ctx->impure = true;
+}
+
+void DeclStmt::findEffects(EffectContext *ctx) {
+    for (Symbol var : VARS) {
+        ctx->bindLocal(var);
+    }
+}
+
+void BlockStmt::findEffects(EffectContext *ctx) {
+    for (auto const& stmt : STMTS) {
+        stmt->findEffects(ctx);
+    }
+}
+
+//stores through a pointer are found as the dereference on the left
+void AssignStmt::findEffects(EffectContext *ctx) {
+    LHS->findEffects(ctx);
+    RHS->findEffects(ctx);
+}
+
+void WhileStmt::findEffects(EffectContext *ctx) {
+    COND->findEffects(ctx);
+    BODY->findEffects(ctx);
+}
+
+void IfStmt::findEffects(EffectContext *ctx) {
+    COND->findEffects(ctx);
+    THEN->findEffects(ctx);
+    if (ELSE) {
+        ELSE->findEffects(ctx);
+    }
+}
+
+void OutputStmt::findEffects(EffectContext *ctx) {
+    ctx->impure = true;
+}
+
+void ErrorStmt::findEffects(EffectContext *ctx) {
+    ctx->impure = true;
+}
+
+void ReturnStmt::findEffects(EffectContext *ctx) {
+    ARG->findEffects(ctx);
+}
+
+void Function::findEffects(EffectContext *ctx) {
+    ctx->clearLocals();
+    for (Symbol param : FORMALS) {
+        ctx->bindLocal(param);
+    }
+    for (auto const &decl : DECLS) {
+        decl->findEffects(ctx);
+    }
+    for (auto const &stmt : BODY) {
+        stmt->findEffects(ctx);
+    }
+}
+
+std::vector<bool> Program::findPureFunctions() {
+    EffectContext ctx;
+    ctx.isFunction.assign(SYMBOLS->size(), false);
+    ctx.isLocal.assign(SYMBOLS->size(), false);
+    for (auto const& fun : FUNCTIONS) {
+        ctx.isFunction[fun->getName().id] = true;
+    }
+
+    std::vector<bool> pure(SYMBOLS->size(), false);
+    std::vector<std::vector<int>> callers(SYMBOLS->size());
+    std::vector<int> impure;
+    for (auto const& fun : FUNCTIONS) {
+        int sym = fun->getName().id;
+        ctx.impure = false;
+        ctx.callees.clear();
+        fun->findEffects(&ctx);
+        //main is called by the intrinsics with the program arguments
+        pure[sym] = !ctx.impure && fun->getName().name != "main";
+        if (!pure[sym]) {
+            impure.push_back(sym);
+        }
+        for (int callee : ctx.callees) {
+            callers[callee].push_back(sym);
+        }
+    }
+
+    //the callers of an impure function are impure
+    while (!impure.empty()) {
+        int sym = impure.back();
+        impure.pop_back();
+        for (int caller : callers[sym]) {
+            if (pure[caller]) {
+                pure[caller] = false;
+                impure.push_back(caller);
+            }
+        }
+    }
+    return pure;
+}
+
+}
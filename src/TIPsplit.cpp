@@ -0,0 +1,53 @@
+#include "TIPsplit.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace llvm;
+
+unsigned
+forEachPartition(std::unique_ptr<Module> theModule, unsigned numParts,
+                 const std::function<void(Module &, unsigned)> &process) {
+  // Serialize the partitions, which all share the context of theModule
+  std::vector<SmallString<0>> partitions;
+  SplitModule(std::move(theModule), numParts,
+              [&partitions](std::unique_ptr<Module> part) {
+                partitions.emplace_back();
+                raw_svector_ostream os(partitions.back());
+                WriteBitcodeToFile(*part, os);
+              });
+
+  std::atomic<unsigned> nextPart(0);
+  auto worker = [&partitions, &nextPart, &process]() {
+    for (unsigned p = nextPart++; p < partitions.size(); p = nextPart++) {
+      LLVMContext partContext;
+      MemoryBufferRef buffer(partitions[p].str(), "tip-partition");
+      auto part = parseBitcodeFile(buffer, partContext);
+      if (!part) {
+        // the bitcode was written by this process, so this is a bug
+        report_fatal_error(part.takeError());
+      }
+      process(**part, p);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (unsigned w = 1; w < numParts && w < partitions.size(); w++) {
+    workers.emplace_back(worker);
+  }
+  worker();
+  for (auto &w : workers) {
+    w.join();
+  }
+
+  return partitions.size();
+}
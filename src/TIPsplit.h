@@ -0,0 +1,25 @@
+#pragma once
+
+#include "llvm/IR/Module.h"
+#include <functional>
+#include <memory>
+
+/*
+ * Parallel processing of the functions of one module.
+ *
+ * The module is split into partitions of its functions with LLVM's
+ * SplitModule, which externalizes local symbols, such as "_tip_ftable",
+ * so that each is defined in exactly one partition and declared in the
+ * partitions that reference it.  An LLVMContext can only be used by one
+ * thread at a time, so each partition is written to bitcode and read back
+ * into a context of its own on the worker thread that processes it.
+ */
+
+/*
+ * Split theModule into at most numParts partitions and call process on
+ * each on a pool of numParts threads, with the partition and its number.
+ * Returns the number of partitions, which are numbered from 0.
+ */
+unsigned
+forEachPartition(std::unique_ptr<llvm::Module> theModule, unsigned numParts,
+                 const std::function<void(llvm::Module &, unsigned)> &process);
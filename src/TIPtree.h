@@ -2,7 +2,10 @@
 
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Module.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
 #include "llvm/IR/Value.h"
+#include "llvm/Support/Allocator.h"
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
@@ -17,24 +20,120 @@
  * Abstract Syntax Tree for TIP
  *****************************************************************/
 class UnionFindSolver;
+struct TIPprofile;
 
 namespace TIPtree {
 
-// AstNode - node identifying and typechecking interface
+class IdContext;
+class CodegenContext;
+class EffectContext;
+class PointsToContext;
+
+/*
+ * AstNode - node identifying and typechecking interface
+ *
+ * Each node records its kind, so it can be tested and cast with
+ * llvm::isa<> and llvm::dyn_cast<> rather than with RTTI or by printing
+ * it.  The kinds of the expressions and of the statements are contiguous.
+ */
 class AstNode {
 public:
+  enum NodeKind {
+    // expressions
+    NK_NumberExpr, NK_VariableExpr, NK_BinaryExpr, NK_FunAppExpr, NK_InputExpr,
+    NK_AllocExpr, NK_RefExpr, NK_DeRefExpr, NK_NullExpr, NK_FieldExpr,
+    NK_RecordExpr, NK_AccessExpr,
+    // statements
+    NK_DeclStmt, NK_BlockStmt, NK_AssignStmt, NK_WhileStmt, NK_IfStmt,
+    NK_OutputStmt, NK_ErrorStmt, NK_ReturnStmt,
+    NK_Function,
+    NK_Program
+  };
+
+private:
+  const NodeKind kind;
+
+protected:
+  AstNode(NodeKind kind) : kind(kind) {}
+
+public:
+  virtual ~AstNode() = default;
+  NodeKind getKind() const { return kind; }
   int id = 0;
-  virtual void genId() = 0;
+  // source location of the start of the node, 0 when unknown
+  int line = 0, column = 0;
+  // number this node and its children, ids are unique within the Program
+  virtual void genId(IdContext *ids) = 0;
   int getId();
+  // add the type constraints of this node and its children to the solver
   virtual void typecheck(UnionFindSolver* solver) = 0;
 };
 
 // Node - this is a base class for all tree nodes
 class Node : public AstNode{
 public:
-  virtual ~Node() = default;
-  virtual llvm::Value *codegen() = 0;
+  Node(NodeKind kind) : AstNode(kind) {}
+  virtual llvm::Value *codegen(CodegenContext *ctx) = 0;
   virtual std::string print() = 0;
+  // record the side effects and the calls of this node and its children
+  virtual void findEffects(EffectContext *ctx) = 0;
+  /*
+   * Add the points-to constraints of this node and its children, returns
+   * the class of the locations that the value of an expression may point
+   * to, or -1 for a statement.
+   */
+  virtual int findPointsTo(PointsToContext *ctx) = 0;
+};
+
+/*
+ * AstArena - owner of all of the nodes of a Program
+ *
+ * Nodes are bump allocated so that the nodes of a function are laid out
+ * contiguously.  Nodes refer to their children with plain pointers and
+ * the arena destroys every node, and releases its slabs, when it is
+ * destroyed along with the Program.
+ */
+class AstArena {
+  llvm::BumpPtrAllocator Allocator;
+  std::vector<AstNode *> Nodes;
+
+public:
+  AstArena() = default;
+  AstArena(const AstArena &) = delete;
+  AstArena &operator=(const AstArena &) = delete;
+  ~AstArena();
+
+  template <typename T, typename... Args> T *make(Args &&... args) {
+    T *node = new (Allocator.Allocate<T>()) T(std::forward<Args>(args)...);
+    Nodes.push_back(node);
+    return node;
+  }
+};
+
+/*
+ * Symbol - an identifier interned in the SymbolTable of a Program
+ *
+ * Passes key their tables on the small, dense, integer id of a symbol
+ * rather than on strings.  The name refers to the single copy of the
+ * identifier that is held by the table.
+ */
+struct Symbol {
+  int id = -1;
+  llvm::StringRef name;
+  std::string str() const { return name.str(); }
+};
+
+// SymbolTable - interns each identifier of a Program exactly once
+class SymbolTable {
+  llvm::StringMap<int> Ids;
+  std::vector<llvm::StringRef> Names;
+
+public:
+  Symbol intern(llvm::StringRef name);
+  // returns a symbol with id -1 if the name was never interned
+  Symbol lookup(llvm::StringRef name) const;
+  Symbol get(int id) const;
+  int size() const { return Names.size(); }
 };
 
 /******************* Expression AST Nodes *********************/
@@ -42,7 +141,11 @@ public:
 // Expr - Base class for all expression nodes.
 class Expr : public Node {
 public:
+  Expr(NodeKind kind) : Node(kind) {}
   ~Expr() = default;
+  static bool classof(const AstNode *n) {
+    return n->getKind() >= NK_NumberExpr && n->getKind() <= NK_AccessExpr;
+  }
   // delegating the obligation to override the functions
 };
 
@@ -50,147 +153,219 @@ public:
 class NumberExpr : public Expr {
   int VAL;
 public:  
-  NumberExpr(int VAL) : VAL(VAL) {}
-  llvm::Value *codegen() override;
+  NumberExpr(int VAL) : Expr(NK_NumberExpr), VAL(VAL) {}
+  llvm::Value *codegen(CodegenContext *ctx) override;
   std::string print() override;
   void typecheck(UnionFindSolver* solver) override;
-  void genId() override;
+  void genId(IdContext *ids) override;
+  void findEffects(EffectContext *ctx) override;
+  int findPointsTo(PointsToContext *ctx) override;
+  static bool classof(const AstNode *n) {
+    return n->getKind() == NK_NumberExpr;
+  }
 };
 
 /// VariableExpr - class for referencing a variable
 class VariableExpr : public Expr {
-  std::string NAME;
+  Symbol NAME;
 public:  
-  VariableExpr(const std::string &NAME) : NAME(NAME) {}
-  llvm::Value *codegen() override;
+  VariableExpr(Symbol NAME) : Expr(NK_VariableExpr), NAME(NAME) {}
+  llvm::Value *codegen(CodegenContext *ctx) override;
   std::string print() override;
   void typecheck(UnionFindSolver* solver) override;
   // Getter to distinguish LHS of assigment for codegen
-  std::string getName() { return NAME; };
-  void genId() override;
+  llvm::StringRef getName() { return NAME.name; };
+  Symbol getSymbol() { return NAME; };
+  void genId(IdContext *ids) override;
+  void findEffects(EffectContext *ctx) override;
+  int findPointsTo(PointsToContext *ctx) override;
+  static bool classof(const AstNode *n) {
+    return n->getKind() == NK_VariableExpr;
+  }
 };
 
+// BinaryOp - the operators of binary expressions
+enum BinaryOp { OpMul, OpDiv, OpAdd, OpSub, OpGt, OpEq };
+
 /// BinaryExpr - class for a binary operator.
 class BinaryExpr : public Expr {
-  std::string OP;
-  std::unique_ptr<Expr> LHS, RHS;
+  BinaryOp OP;
+  Expr *LHS, *RHS;
 public:  
-  BinaryExpr(const std::string &OP, std::unique_ptr<Expr> LHS,
-             std::unique_ptr<Expr> RHS)
-      : OP(OP), LHS(std::move(LHS)), RHS(std::move(RHS)) {}
-  llvm::Value *codegen() override;
+  BinaryExpr(BinaryOp OP, Expr *LHS, Expr *RHS)
+      : Expr(NK_BinaryExpr), OP(OP), LHS(LHS), RHS(RHS) {}
+  llvm::Value *codegen(CodegenContext *ctx) override;
   std::string print() override;
   void typecheck(UnionFindSolver* solver) override;
-  void genId() override;
+  void genId(IdContext *ids) override;
+  void findEffects(EffectContext *ctx) override;
+  int findPointsTo(PointsToContext *ctx) override;
+  static bool classof(const AstNode *n) {
+    return n->getKind() == NK_BinaryExpr;
+  }
 };
 
 /// FunAppExpr - class for function calls.
 class FunAppExpr : public Expr {
-  std::unique_ptr<Expr> FUN;
-  std::vector<std::unique_ptr<Expr>> ACTUALS;
+  Expr *FUN;
+  std::vector<Expr *> ACTUALS;
 public:  
-  FunAppExpr(std::unique_ptr<Expr> FUN,
-             std::vector<std::unique_ptr<Expr>> ACTUALS)
-      : FUN(std::move(FUN)), ACTUALS(std::move(ACTUALS)) {}
-  llvm::Value *codegen() override;
+  FunAppExpr(Expr *FUN, std::vector<Expr *> ACTUALS)
+      : Expr(NK_FunAppExpr), FUN(FUN), ACTUALS(std::move(ACTUALS)) {}
+  llvm::Value *codegen(CodegenContext *ctx) override;
   std::string print() override;
   void typecheck(UnionFindSolver* solver) override;
-  void genId() override;
+  void genId(IdContext *ids) override;
+  void findEffects(EffectContext *ctx) override;
+  int findPointsTo(PointsToContext *ctx) override;
+  static bool classof(const AstNode *n) {
+    return n->getKind() == NK_FunAppExpr;
+  }
 };
 
 /// InputExpr - class for input expression
 class InputExpr : public Expr {
 
 public:
-  InputExpr() {}
-  llvm::Value *codegen() override;
+  InputExpr() : Expr(NK_InputExpr) {}
+  llvm::Value *codegen(CodegenContext *ctx) override;
   std::string print() override;
   void typecheck(UnionFindSolver* solver) override;
-  void genId() override;
+  void genId(IdContext *ids) override;
+  void findEffects(EffectContext *ctx) override;
+  int findPointsTo(PointsToContext *ctx) override;
+  static bool classof(const AstNode *n) {
+    return n->getKind() == NK_InputExpr;
+  }
 };
 
 // AllocExpr - class for alloc expression
 class AllocExpr : public Expr {
-  std::unique_ptr<Expr> ARG;
+  Expr *ARG;
 public:  
-  AllocExpr(std::unique_ptr<Expr> ARG) : ARG(std::move(ARG)) {}
-  llvm::Value *codegen() override;
+  AllocExpr(Expr *ARG) : Expr(NK_AllocExpr), ARG(ARG) {}
+  llvm::Value *codegen(CodegenContext *ctx) override;
   std::string print() override;
   void typecheck(UnionFindSolver* solver) override;
-  void genId() override;
+  void genId(IdContext *ids) override;
+  void findEffects(EffectContext *ctx) override;
+  int findPointsTo(PointsToContext *ctx) override;
+  static bool classof(const AstNode *n) {
+    return n->getKind() == NK_AllocExpr;
+  }
 };
 
 // RefExpr - class for referencing the address of a variable
 class RefExpr : public Expr {
-  std::string NAME;
+  Symbol NAME;
 public:  
   int refId;
-  RefExpr(const std::string &NAME) : NAME(NAME) {}
-  llvm::Value *codegen() override;
+  RefExpr(Symbol NAME) : Expr(NK_RefExpr), NAME(NAME) {}
+  llvm::Value *codegen(CodegenContext *ctx) override;
   std::string print() override;
   void typecheck(UnionFindSolver* solver) override;
-  void genId() override;
+  void genId(IdContext *ids) override;
+  void findEffects(EffectContext *ctx) override;
+  int findPointsTo(PointsToContext *ctx) override;
   int getRefId();
+  static bool classof(const AstNode *n) {
+    return n->getKind() == NK_RefExpr;
+  }
 };
 
 // DeRefExpr - class for dereferencing a pointer expression
 class DeRefExpr : public Expr {
-  std::unique_ptr<Expr> ARG;
+  Expr *ARG;
 public:  
-  DeRefExpr(std::unique_ptr<Expr> ARG) : ARG(std::move(ARG)) {}
-  llvm::Value *codegen() override;
+  DeRefExpr(Expr *ARG) : Expr(NK_DeRefExpr), ARG(ARG) {}
+  llvm::Value *codegen(CodegenContext *ctx) override;
   std::string print() override;
   void typecheck(UnionFindSolver* solver) override;
-  void genId() override;
+  void genId(IdContext *ids) override;
+  void findEffects(EffectContext *ctx) override;
+  int findPointsTo(PointsToContext *ctx) override;
+  static bool classof(const AstNode *n) {
+    return n->getKind() == NK_DeRefExpr;
+  }
 };
 
 /// NullExpr - class for a null expression
 class NullExpr : public Expr {
 
 public:
-  NullExpr() {}
-  llvm::Value *codegen() override;
+  NullExpr() : Expr(NK_NullExpr) {}
+  llvm::Value *codegen(CodegenContext *ctx) override;
   std::string print() override;
   void typecheck(UnionFindSolver* solver) override;
-  void genId() override;
+  void genId(IdContext *ids) override;
+  void findEffects(EffectContext *ctx) override;
+  int findPointsTo(PointsToContext *ctx) override;
+  static bool classof(const AstNode *n) {
+    return n->getKind() == NK_NullExpr;
+  }
 };
 
+/*
+ * Record fields are numbered program-wide as they are first seen during
+ * the build, so a field has the same index in every record.  Records are
+ * laid out with one slot per field of the program at that index.
+ */
+
 // FieldExpr - class for the field of a structure
 class FieldExpr : public Expr {
-  std::string FIELD;
-  std::unique_ptr<Expr> INIT;
+  Symbol FIELD;
+  int INDEX;
+  Expr *INIT;
 public:  
-  FieldExpr(const std::string &FIELD, std::unique_ptr<Expr> INIT)
-      : FIELD(FIELD), INIT(std::move(INIT)) {}
-  llvm::Value *codegen() override;
+  FieldExpr(Symbol FIELD, int INDEX, Expr *INIT)
+      : Expr(NK_FieldExpr), FIELD(FIELD), INDEX(INDEX), INIT(INIT) {}
+  int getIndex() { return INDEX; }
+  Expr *getInit() { return INIT; }
+  llvm::Value *codegen(CodegenContext *ctx) override;
   std::string print() override;
   void typecheck(UnionFindSolver* solver) override;
-  void genId() override;
+  void genId(IdContext *ids) override;
+  void findEffects(EffectContext *ctx) override;
+  int findPointsTo(PointsToContext *ctx) override;
+  static bool classof(const AstNode *n) {
+    return n->getKind() == NK_FieldExpr;
+  }
 };
 
 // RecordExpr - class for defining a record
 class RecordExpr : public Expr {
-  std::vector<std::unique_ptr<FieldExpr>> FIELDS;
+  std::vector<FieldExpr *> FIELDS;
 public:  
-  RecordExpr(std::vector<std::unique_ptr<FieldExpr>> FIELDS)
-      : FIELDS(std::move(FIELDS)) {}
-  llvm::Value *codegen() override;
+  RecordExpr(std::vector<FieldExpr *> FIELDS)
+      : Expr(NK_RecordExpr), FIELDS(std::move(FIELDS)) {}
+  llvm::Value *codegen(CodegenContext *ctx) override;
   std::string print() override;
   void typecheck(UnionFindSolver* solver) override;
-  void genId() override;
+  void genId(IdContext *ids) override;
+  void findEffects(EffectContext *ctx) override;
+  int findPointsTo(PointsToContext *ctx) override;
+  static bool classof(const AstNode *n) {
+    return n->getKind() == NK_RecordExpr;
+  }
 };
 
 // AccessExpr - class for a record field access
 class AccessExpr : public Expr {
-  std::unique_ptr<Expr> RECORD;
-  std::string FIELD;
+  Expr *RECORD;
+  Symbol FIELD;
+  int INDEX;
 public:
-  AccessExpr(std::unique_ptr<Expr> RECORD, const std::string &FIELD)
-      : RECORD(std::move(RECORD)), FIELD(FIELD) {}
-  llvm::Value *codegen() override;
+  AccessExpr(Expr *RECORD, Symbol FIELD, int INDEX)
+      : Expr(NK_AccessExpr), RECORD(RECORD), FIELD(FIELD), INDEX(INDEX) {}
+  llvm::Value *codegen(CodegenContext *ctx) override;
   std::string print() override;
   void typecheck(UnionFindSolver* solver) override;
-  void genId() override;
+  void genId(IdContext *ids) override;
+  void findEffects(EffectContext *ctx) override;
+  int findPointsTo(PointsToContext *ctx) override;
+  static bool classof(const AstNode *n) {
+    return n->getKind() == NK_AccessExpr;
+  }
 };
 
 /******************* Statement AST Nodes *********************/
@@ -198,134 +373,178 @@ public:
 // Stmt - Base class for all statement nodes.
 class Stmt : public Node {
 public:
+  Stmt(NodeKind kind) : Node(kind) {}
   ~Stmt() = default;
+  static bool classof(const AstNode *n) {
+    return n->getKind() >= NK_DeclStmt && n->getKind() <= NK_ReturnStmt;
+  }
   // delegating the obligation to override the functions
 };
 
 // DeclStmt - class for declaration
 class DeclStmt : public Stmt {
-  std::vector<std::string> VARS;
+  std::vector<Symbol> VARS;
   std::vector<int> VAR_IDS;
   int LINE; // line on which decl statement occurs
 public:
-  DeclStmt(std::vector<std::string> VARS, int LINE)
-      : VARS(std::move(VARS)), LINE(LINE) {}
-  llvm::Value *codegen() override;
+  DeclStmt(std::vector<Symbol> VARS, int LINE)
+      : Stmt(NK_DeclStmt), VARS(std::move(VARS)), LINE(LINE) {}
+  llvm::Value *codegen(CodegenContext *ctx) override;
   std::string print() override;
   void typecheck(UnionFindSolver* solver) override;
   std::string printTyped(UnionFindSolver* solver);
-  void genId() override;
+  void genId(IdContext *ids) override;
+  void findEffects(EffectContext *ctx) override;
+  int findPointsTo(PointsToContext *ctx) override;
+  static bool classof(const AstNode *n) {
+    return n->getKind() == NK_DeclStmt;
+  }
 };
 
 // BlockStmt - class for block of statements
 class BlockStmt : public Stmt {
-  std::vector<std::unique_ptr<Stmt>> STMTS;
+  std::vector<Stmt *> STMTS;
 public:  
-  BlockStmt(std::vector<std::unique_ptr<Stmt>> STMTS)
-      : STMTS(std::move(STMTS)) {}
-  llvm::Value *codegen() override;
+  BlockStmt(std::vector<Stmt *> STMTS)
+      : Stmt(NK_BlockStmt), STMTS(std::move(STMTS)) {}
+  llvm::Value *codegen(CodegenContext *ctx) override;
   std::string print() override;
   void typecheck(UnionFindSolver* solver) override;
-  void genId() override;
+  void genId(IdContext *ids) override;
+  void findEffects(EffectContext *ctx) override;
+  int findPointsTo(PointsToContext *ctx) override;
+  static bool classof(const AstNode *n) {
+    return n->getKind() == NK_BlockStmt;
+  }
 };
 
 // AssignStmt - class for assignment
 class AssignStmt : public Stmt {
-  std::unique_ptr<Expr> LHS, RHS;
+  Expr *LHS, *RHS;
 public:
-  AssignStmt(std::unique_ptr<Expr> LHS, std::unique_ptr<Expr> RHS)
-      : LHS(std::move(LHS)), RHS(std::move(RHS)) {}
-  llvm::Value *codegen() override;
+  AssignStmt(Expr *LHS, Expr *RHS)
+      : Stmt(NK_AssignStmt), LHS(LHS), RHS(RHS) {}
+  llvm::Value *codegen(CodegenContext *ctx) override;
   std::string print() override;
   void typecheck(UnionFindSolver* solver) override;
-  void genId() override;
+  void genId(IdContext *ids) override;
+  void findEffects(EffectContext *ctx) override;
+  int findPointsTo(PointsToContext *ctx) override;
+  static bool classof(const AstNode *n) {
+    return n->getKind() == NK_AssignStmt;
+  }
 };
 
 // WhileStmt - class for a while loop
 class WhileStmt : public Stmt {
-  std::unique_ptr<Expr> COND;
-  std::unique_ptr<Stmt> BODY;
+  Expr *COND;
+  Stmt *BODY;
 public:
-  WhileStmt(std::unique_ptr<Expr> COND, std::unique_ptr<Stmt> BODY)
-      : COND(std::move(COND)), BODY(std::move(BODY)) {}
-  llvm::Value *codegen() override;
+  WhileStmt(Expr *COND, Stmt *BODY)
+      : Stmt(NK_WhileStmt), COND(COND), BODY(BODY) {}
+  llvm::Value *codegen(CodegenContext *ctx) override;
   std::string print() override;
   void typecheck(UnionFindSolver* solver) override;
-  void genId() override;
+  void genId(IdContext *ids) override;
+  void findEffects(EffectContext *ctx) override;
+  int findPointsTo(PointsToContext *ctx) override;
+  static bool classof(const AstNode *n) {
+    return n->getKind() == NK_WhileStmt;
+  }
 };
 
 /// IfStmt - class for if-then-else
 class IfStmt : public Stmt {
-  std::unique_ptr<Expr> COND;
-  std::unique_ptr<Stmt> THEN, ELSE;
+  Expr *COND;
+  Stmt *THEN, *ELSE;
 public:
-  IfStmt(std::unique_ptr<Expr> COND, std::unique_ptr<Stmt> THEN,
-         std::unique_ptr<Stmt> ELSE)
-      : COND(std::move(COND)), THEN(std::move(THEN)), ELSE(std::move(ELSE)) {}
-  llvm::Value *codegen() override;
+  IfStmt(Expr *COND, Stmt *THEN, Stmt *ELSE)
+      : Stmt(NK_IfStmt), COND(COND), THEN(THEN), ELSE(ELSE) {}
+  llvm::Value *codegen(CodegenContext *ctx) override;
   std::string print() override;
   void typecheck(UnionFindSolver* solver) override;
-  void genId() override;
+  void genId(IdContext *ids) override;
+  void findEffects(EffectContext *ctx) override;
+  int findPointsTo(PointsToContext *ctx) override;
+  static bool classof(const AstNode *n) {
+    return n->getKind() == NK_IfStmt;
+  }
 };
 
 /// OutputStmt - class for a output statement
 class OutputStmt : public Stmt {
-  std::unique_ptr<Expr> ARG;
+  Expr *ARG;
 public:
-  OutputStmt(std::unique_ptr<Expr> ARG) : ARG(std::move(ARG)) {}
-  llvm::Value *codegen() override;
+  OutputStmt(Expr *ARG) : Stmt(NK_OutputStmt), ARG(ARG) {}
+  llvm::Value *codegen(CodegenContext *ctx) override;
   std::string print() override;
   void typecheck(UnionFindSolver* solver) override;
-  void genId() override;
+  void genId(IdContext *ids) override;
+  void findEffects(EffectContext *ctx) override;
+  int findPointsTo(PointsToContext *ctx) override;
+  static bool classof(const AstNode *n) {
+    return n->getKind() == NK_OutputStmt;
+  }
 };
 
 /// ErrorStmt - class for a error statement
 class ErrorStmt : public Stmt {
-  std::unique_ptr<Expr> ARG;
+  Expr *ARG;
 public:
-  ErrorStmt(std::unique_ptr<Expr> ARG) : ARG(std::move(ARG)) {}
-  llvm::Value *codegen() override;
+  ErrorStmt(Expr *ARG) : Stmt(NK_ErrorStmt), ARG(ARG) {}
+  llvm::Value *codegen(CodegenContext *ctx) override;
   std::string print() override;
   void typecheck(UnionFindSolver* solver) override;
-  void genId() override;
+  void genId(IdContext *ids) override;
+  void findEffects(EffectContext *ctx) override;
+  int findPointsTo(PointsToContext *ctx) override;
+  static bool classof(const AstNode *n) {
+    return n->getKind() == NK_ErrorStmt;
+  }
 };
 
 /// ReturnStmt - class for a return statement
 class ReturnStmt : public Stmt {
-  std::unique_ptr<Expr> ARG;
+  Expr *ARG;
 public:
-  ReturnStmt(std::unique_ptr<Expr> ARG) : ARG(std::move(ARG)) {}
-  llvm::Value *codegen() override;
+  ReturnStmt(Expr *ARG) : Stmt(NK_ReturnStmt), ARG(ARG) {}
+  llvm::Value *codegen(CodegenContext *ctx) override;
   std::string print() override;
   void typecheck(UnionFindSolver* solver) override;
   std::string printArg();
-  void genId() override;
+  void genId(IdContext *ids) override;
+  void findEffects(EffectContext *ctx) override;
+  int findPointsTo(PointsToContext *ctx) override;
   int getArgId() {
     return ARG->getId();
   }
+  static bool classof(const AstNode *n) {
+    return n->getKind() == NK_ReturnStmt;
+  }
 };
 
 /******************* Program and Function Nodes *********************/
 
 // Function - signature, local declarations, and a body
 class Function : public AstNode{
-  std::string NAME;
-  std::vector<std::string> FORMALS;
+  Symbol NAME;
+  std::vector<Symbol> FORMALS;
   std::vector<int> FORMAL_IDS;
-  std::vector<std::unique_ptr<DeclStmt>> DECLS;
-  std::vector<std::unique_ptr<Stmt>> BODY;
+  std::vector<DeclStmt *> DECLS;
+  std::vector<Stmt *> BODY;
   int LINE; // line on which function definition occurs
 public:
-  Function(const std::string &NAME, std::vector<std::string> FORMALS,
-           std::vector<std::unique_ptr<DeclStmt>> DECLS,
-           std::vector<std::unique_ptr<Stmt>> BODY, int LINE)
-      : NAME(NAME), FORMALS(std::move(FORMALS)), DECLS(std::move(DECLS)),
-        BODY(std::move(BODY)), LINE(LINE) {}
-  llvm::Function *codegen();
+  Function(Symbol NAME, std::vector<Symbol> FORMALS,
+           std::vector<DeclStmt *> DECLS, std::vector<Stmt *> BODY, int LINE)
+      : AstNode(NK_Function), NAME(NAME), FORMALS(std::move(FORMALS)),
+        DECLS(std::move(DECLS)), BODY(std::move(BODY)), LINE(LINE) {}
+  llvm::Function *codegen(CodegenContext *ctx);
   std::string print();
   void typecheck(UnionFindSolver* solver);
   std::string printTyped(UnionFindSolver* solver);
-  void genId() override;
+  void genId(IdContext *ids) override;
+  void findEffects(EffectContext *ctx);
+  void findPointsTo(PointsToContext *ctx);
   /*
    * These getters are needed because we perform two passes over
    * functions during code generation:
@@ -333,21 +552,91 @@ public:
    *   2) a deep pass that generates function implementations
    * The getters support first pass.
    */
-  std::string getName() { return NAME; };
-  std::vector<std::string> getFormals() { return FORMALS; };
+  Symbol getName() { return NAME; };
+  const std::vector<Symbol> &getFormals() { return FORMALS; };
+  const std::vector<int> &getFormalIds() { return FORMAL_IDS; };
+  static bool classof(const AstNode *n) {
+    return n->getKind() == NK_Function;
+  }
+};
+
+/*
+ * CodegenOptions - how Program::codegen generates the code of a program
+ *
+ * With useGC the program allocates from the collected heap of the
+ * intrinsics.  Given the solver of a successful typecheck, values are
+ * lowered to their inferred types, otherwise every value is an Int64.
+ * Given a profile the code is instrumented to collect it, or annotated
+ * with its counts.  With instrument each function reports its calls to
+ * the profiler of the intrinsics.  With memoize the calls of pure
+ * functions go through memo tables in the intrinsics.  With aliasScopes
+ * the loads and stores are annotated with the alias classes of the
+ * points-to analysis, and with stackAllocs the cells that do not escape
+ * are allocated on the stack, both of which need the nodes to be
+ * numbered.
+ */
+struct CodegenOptions {
+  bool useGC = false;
+  UnionFindSolver *solver = nullptr;
+  const TIPprofile *profile = nullptr;
+  bool instrument = false;
+  bool memoize = false;
+  bool aliasScopes = false;
+  bool stackAllocs = false;
 };
 
-// Program - just a list of functions
+// Program - a list of functions, with the arena and symbols they use
 class Program : public AstNode{
-  std::vector<std::unique_ptr<Function>> FUNCTIONS;
+  std::unique_ptr<AstArena> ARENA;
+  std::unique_ptr<SymbolTable> SYMBOLS;
+  // record field names by field index
+  std::vector<Symbol> FIELDS;
+  std::vector<Function *> FUNCTIONS;
+  // one more than the largest node id, set by genId
+  int NUM_IDS = 0;
 public:
-  Program(std::vector<std::unique_ptr<Function>> FUNCTIONS)
-      : FUNCTIONS(std::move(FUNCTIONS)) {}
-  std::unique_ptr<llvm::Module> codegen(std::string programName);
+  Program(std::vector<Function *> FUNCTIONS, std::unique_ptr<AstArena> ARENA,
+          std::unique_ptr<SymbolTable> SYMBOLS, std::vector<Symbol> FIELDS)
+      : AstNode(NK_Program), ARENA(std::move(ARENA)),
+        SYMBOLS(std::move(SYMBOLS)), FIELDS(std::move(FIELDS)),
+        FUNCTIONS(std::move(FUNCTIONS)) {}
+  /*
+   * Generate the module of the program, as the options select.  The
+   * module is created in TheContext, which must not be in use by another
+   * thread while the program is compiled.
+   */
+  std::unique_ptr<llvm::Module> codegen(llvm::LLVMContext &TheContext,
+                                        std::string programName,
+                                        const CodegenOptions &options);
   std::string print(std::string i, bool pl);
-  std::string printTyped();
-  void genId() override;
+  std::string printTyped(UnionFindSolver* solver);
+  // number all of the nodes of the program
+  void genId();
+  void genId(IdContext *ids) override;
+  // infer the types of the whole program, throws TIPTypeError on failure
   void typecheck(UnionFindSolver* solver) override;
+  /*
+   * Find the functions without side effects, whose results only depend
+   * on their arguments, indexed by the symbol id of their names.
+   */
+  std::vector<bool> findPureFunctions();
+  /*
+   * Find the classes of the locations that may be aliased, by a
+   * unification based points-to analysis of the numbered nodes.  The
+   * classes of the loads and stores of each node are indexed by its id:
+   * the locations of a dereference, an access or an allocation, and of a
+   * variable whose address is taken, with -1 for the other nodes.
+   */
+  std::vector<int> findAliasClasses();
+  /*
+   * Find the allocations whose cells cannot be referred to once the call
+   * of their function returns, indexed by node id.
+   */
+  std::vector<bool> findStackAllocs();
+  void findPointsTo(PointsToContext *ctx);
+  static bool classof(const AstNode *n) {
+    return n->getKind() == NK_Program;
+  }
 };
 
 } // namespace TIPtree
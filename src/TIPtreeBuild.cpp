@@ -5,8 +5,6 @@ using namespace antlrcpp;
 
 using namespace TIPtree;
 
-TIPtreeBuild::TIPtreeBuild(TIPParser *p) : parser{p} {}
-
 /*
  * Questions:
  *   ? when exactly do I need to use std::move
@@ -14,46 +12,36 @@ TIPtreeBuild::TIPtreeBuild(TIPParser *p) : parser{p} {}
  *        (in ctor and in ctor invocatin)
  */
 
-std::string TIPtreeBuild::opString(int op) {
-  std::string opStr;
-  switch (op) {
+BinaryOp TIPtreeBuild::opCode(antlr4::Token *op) {
+  switch (op->getType()) {
   case TIPParser::MUL:
-    opStr = "*";
-    break;
+    return OpMul;
   case TIPParser::DIV:
-    opStr = "/";
-    break;
+    return OpDiv;
   case TIPParser::ADD:
-    opStr = "+";
-    break;
+    return OpAdd;
   case TIPParser::SUB:
-    opStr = "-";
-    break;
+    return OpSub;
   case TIPParser::GT:
-    opStr = ">";
-    break;
+    return OpGt;
   case TIPParser::EQ:
-    opStr = "==";
-    break;
+    return OpEq;
   default:
-    std::runtime_error(
-        "unknown operator :" +
-        TIPtreeBuild::parser->getVocabulary().getLiteralName(op));
+    throw std::runtime_error("unknown operator :" + op->getText());
   }
-  return opStr;
 }
 
-/*
- * Globals for communicating information up from visited subtrees
- * These are overwritten by every visit call.
- * We use multiple variables here since downcasting of unique smart pointers
- * is not supported.
- */
-static std::unique_ptr<Stmt> visitedStmt = nullptr;
-static std::unique_ptr<DeclStmt> visitedDeclStmt = nullptr;
-static std::unique_ptr<Expr> visitedExpr = nullptr;
-static std::unique_ptr<FieldExpr> visitedFieldExpr = nullptr;
-static std::unique_ptr<Function> visitedFunction = nullptr;
+// Number record fields program-wide in the order they are first seen
+int TIPtreeBuild::getFieldIndex(Symbol field) {
+  if (field.id >= (int)fieldIndex.size()) {
+    fieldIndex.resize(field.id + 1, -1);
+  }
+  if (fieldIndex[field.id] == -1) {
+    fieldIndex[field.id] = fields.size();
+    fields.push_back(field);
+  }
+  return fieldIndex[field.id];
+}
 
 /**********************************************************************
  * These methods override selected methods in the TIPBaseVisitor.
@@ -83,26 +71,48 @@ static std::unique_ptr<Function> visitedFunction = nullptr;
  * of the fields that contain the program elements captured during the parse.
  * You will access these from the method overrides in your visitor.
  *
- * Note that we use llvm::make_unique here instead of std::make_unique
- * to have a bit of consistency with the other parts of the compiler
- * that interact with LLVM and are thus constrained to C++ 11.
+ * All nodes are allocated from the AstArena, via make, which also records
+ * the source location of the node for diagnostics, and every identifier
+ * is interned in the SymbolTable the first time it is seen.
+ * Both are handed over to the Program at the end of the build.  Note that we use
+ * llvm::make_unique here instead of std::make_unique to have a bit of
+ * consistency with the other parts of the compiler that interact with LLVM
+ * and are thus constrained to C++ 11.
  */
 
 std::unique_ptr<TIPtree::Program>
 TIPtreeBuild::build(TIPParser::ProgramContext *ctx) {
-  std::vector<std::unique_ptr<Function>> pFunctions;
+  beginProgram();
   for (auto fn : ctx->function()) {
-    visit(fn);
-    pFunctions.push_back(std::move(visitedFunction));
+    addFunction(fn);
   }
-  return llvm::make_unique<Program>(std::move(pFunctions));
+  return endProgram();
+}
+
+void TIPtreeBuild::beginProgram() {
+  arena = llvm::make_unique<AstArena>();
+  symbols = llvm::make_unique<SymbolTable>();
+  fieldIndex.clear();
+  fields.clear();
+  functions.clear();
+}
+
+// The function holds no references into the parse tree once it is built
+void TIPtreeBuild::addFunction(TIPParser::FunctionContext *ctx) {
+  visit(ctx);
+  functions.push_back(visitedFunction);
+}
+
+std::unique_ptr<TIPtree::Program> TIPtreeBuild::endProgram() {
+  return llvm::make_unique<Program>(std::move(functions), std::move(arena),
+                                    std::move(symbols), std::move(fields));
 }
 
 Any TIPtreeBuild::visitFunction(TIPParser::FunctionContext *ctx) {
-  std::string fName; // always initialized in the "count == 0" case
-  std::vector<std::string> fParams;
-  std::vector<std::unique_ptr<DeclStmt>> fDecls;
-  std::vector<std::unique_ptr<Stmt>> fBody;
+  Symbol fName; // always initialized in the "count == 0" case
+  std::vector<Symbol> fParams;
+  std::vector<DeclStmt *> fDecls;
+  std::vector<Stmt *> fBody;
   int fLine;
 
   /*
@@ -115,36 +125,36 @@ Any TIPtreeBuild::visitFunction(TIPParser::FunctionContext *ctx) {
   for (auto id : ctx->IDENTIFIER()) {
     if (firstId) {
       firstId = !firstId;
-      fName = id->getText();
+      fName = symbols->intern(id->getText());
       fLine = id->getSymbol()->getLine();
     } else {
-      fParams.push_back(std::move(id->getText()));
+      fParams.push_back(symbols->intern(id->getText()));
     }
   }
 
   for (auto decl : ctx->declaration()) {
     visit(decl);
-    fDecls.push_back(std::move(visitedDeclStmt));
+    fDecls.push_back(visitedDeclStmt);
   }
 
   for (auto stmt : ctx->statement()) {
     visit(stmt);
-    fBody.push_back(std::move(visitedStmt));
+    fBody.push_back(visitedStmt);
   }
 
   // return statement is always the last statement in a TIP function body
   visit(ctx->returnStmt());
-  fBody.push_back(std::move(visitedStmt));
+  fBody.push_back(visitedStmt);
 
-  visitedFunction = llvm::make_unique<Function>(
-      fName, std::move(fParams), std::move(fDecls), std::move(fBody), fLine);
+  visitedFunction = make<Function>(ctx, fName, std::move(fParams),
+                                   std::move(fDecls), std::move(fBody), fLine);
   return "";
 }
 
 Any TIPtreeBuild::visitNegNumber(TIPParser::NegNumberContext *ctx) {
   int val = std::stoi(ctx->NUMBER()->getText());
   val = -val;
-  visitedExpr = llvm::make_unique<NumberExpr>(val);
+  visitedExpr = make<NumberExpr>(ctx, val);
   return "";
 }
 
@@ -159,59 +169,55 @@ Any TIPtreeBuild::visitNegNumber(TIPParser::NegNumberContext *ctx) {
  * mechanism for handling operator precedence would be needed.
  */
 Any TIPtreeBuild::visitAdditiveExpr(TIPParser::AdditiveExprContext *ctx) {
-  std::string op = opString(ctx->op->getType());
+  BinaryOp op = opCode(ctx->op);
 
   visit(ctx->expr(0));
-  std::unique_ptr<Expr> lhs = std::move(visitedExpr);
+  Expr *lhs = visitedExpr;
 
   visit(ctx->expr(1));
-  std::unique_ptr<Expr> rhs = std::move(visitedExpr);
+  Expr *rhs = visitedExpr;
 
-  visitedExpr =
-      llvm::make_unique<BinaryExpr>(op, std::move(lhs), std::move(rhs));
+  visitedExpr = make<BinaryExpr>(ctx, op, lhs, rhs);
   return "";
 }
 
 Any TIPtreeBuild::visitRelationalExpr(TIPParser::RelationalExprContext *ctx) {
-  std::string op = opString(ctx->op->getType());
+  BinaryOp op = opCode(ctx->op);
 
   visit(ctx->expr(0));
-  std::unique_ptr<Expr> lhs = std::move(visitedExpr);
+  Expr *lhs = visitedExpr;
 
   visit(ctx->expr(1));
-  std::unique_ptr<Expr> rhs = std::move(visitedExpr);
+  Expr *rhs = visitedExpr;
 
-  visitedExpr =
-      llvm::make_unique<BinaryExpr>(op, std::move(lhs), std::move(rhs));
+  visitedExpr = make<BinaryExpr>(ctx, op, lhs, rhs);
   return "";
 }
 
 Any TIPtreeBuild::visitMultiplicativeExpr(
     TIPParser::MultiplicativeExprContext *ctx) {
-  std::string op = opString(ctx->op->getType());
+  BinaryOp op = opCode(ctx->op);
 
   visit(ctx->expr(0));
-  std::unique_ptr<Expr> lhs = std::move(visitedExpr);
+  Expr *lhs = visitedExpr;
 
   visit(ctx->expr(1));
-  std::unique_ptr<Expr> rhs = std::move(visitedExpr);
+  Expr *rhs = visitedExpr;
 
-  visitedExpr =
-      llvm::make_unique<BinaryExpr>(op, std::move(lhs), std::move(rhs));
+  visitedExpr = make<BinaryExpr>(ctx, op, lhs, rhs);
   return "";
 }
 
 Any TIPtreeBuild::visitEqualityExpr(TIPParser::EqualityExprContext *ctx) {
-  std::string op = opString(ctx->op->getType());
+  BinaryOp op = opCode(ctx->op);
 
   visit(ctx->expr(0));
-  std::unique_ptr<Expr> lhs = std::move(visitedExpr);
+  Expr *lhs = visitedExpr;
 
   visit(ctx->expr(1));
-  std::unique_ptr<Expr> rhs = std::move(visitedExpr);
+  Expr *rhs = visitedExpr;
 
-  visitedExpr =
-      llvm::make_unique<BinaryExpr>(op, std::move(lhs), std::move(rhs));
+  visitedExpr = make<BinaryExpr>(ctx, op, lhs, rhs);
   return "";
 }
 
@@ -223,32 +229,32 @@ Any TIPtreeBuild::visitParenExpr(TIPParser::ParenExprContext *ctx) {
 
 Any TIPtreeBuild::visitNumExpr(TIPParser::NumExprContext *ctx) {
   int val = std::stoi(ctx->NUMBER()->getText());
-  visitedExpr = llvm::make_unique<NumberExpr>(val);
+  visitedExpr = make<NumberExpr>(ctx, val);
   return "";
 }
 
 Any TIPtreeBuild::visitIdExpr(TIPParser::IdExprContext *ctx) {
-  std::string name = ctx->IDENTIFIER()->getText();
-  visitedExpr = llvm::make_unique<VariableExpr>(name);
+  Symbol name = symbols->intern(ctx->IDENTIFIER()->getText());
+  visitedExpr = make<VariableExpr>(ctx, name);
   return "";
 }
 
 Any TIPtreeBuild::visitInputExpr(TIPParser::InputExprContext *ctx) {
-  visitedExpr = llvm::make_unique<InputExpr>();
+  visitedExpr = make<InputExpr>(ctx);
   return "";
 }
 
 Any TIPtreeBuild::visitFunAppExpr(TIPParser::FunAppExprContext *ctx) {
-  std::unique_ptr<Expr> fExpr = nullptr;
-  std::vector<std::unique_ptr<Expr>> fArgs;
+  Expr *fExpr = nullptr;
+  std::vector<Expr *> fArgs;
 
   // function determined by name or computed expression
   if (ctx->IDENTIFIER() != nullptr) {
-    std::string name = ctx->IDENTIFIER()->getText();
-    fExpr = llvm::make_unique<VariableExpr>(name);
+    Symbol name = symbols->intern(ctx->IDENTIFIER()->getText());
+    fExpr = make<VariableExpr>(ctx, name);
   } else if (ctx->parenExpr() != nullptr) {
     visit(ctx->parenExpr());
-    fExpr = std::move(visitedExpr);
+    fExpr = visitedExpr;
   } else {
     // one of these alternative must be defined
     assert(false);
@@ -256,86 +262,86 @@ Any TIPtreeBuild::visitFunAppExpr(TIPParser::FunAppExprContext *ctx) {
 
   for (auto e : ctx->expr()) {
     visit(e);
-    fArgs.push_back(std::move(visitedExpr));
+    fArgs.push_back(visitedExpr);
   }
 
-  visitedExpr =
-      llvm::make_unique<FunAppExpr>(std::move(fExpr), std::move(fArgs));
+  visitedExpr = make<FunAppExpr>(ctx, fExpr, std::move(fArgs));
   return "";
 }
 
 Any TIPtreeBuild::visitAllocExpr(TIPParser::AllocExprContext *ctx) {
   visit(ctx->expr());
-  visitedExpr = llvm::make_unique<AllocExpr>(std::move(visitedExpr));
+  visitedExpr = make<AllocExpr>(ctx, visitedExpr);
   return "";
 }
 
 Any TIPtreeBuild::visitRefExpr(TIPParser::RefExprContext *ctx) {
-  std::string vName = ctx->IDENTIFIER()->getText();
-  visitedExpr = llvm::make_unique<RefExpr>(vName);
+  Symbol vName = symbols->intern(ctx->IDENTIFIER()->getText());
+  visitedExpr = make<RefExpr>(ctx, vName);
   return "";
 }
 
 Any TIPtreeBuild::visitDeRefExpr(TIPParser::DeRefExprContext *ctx) {
   visit(ctx->atom());
-  visitedExpr = llvm::make_unique<DeRefExpr>(std::move(visitedExpr));
+  visitedExpr = make<DeRefExpr>(ctx, visitedExpr);
   return "";
 }
 
 Any TIPtreeBuild::visitNullExpr(TIPParser::NullExprContext *ctx) {
-  visitedExpr = llvm::make_unique<NullExpr>();
+  visitedExpr = make<NullExpr>(ctx);
   return "";
 }
 
 Any TIPtreeBuild::visitRecordExpr(TIPParser::RecordExprContext *ctx) {
-  std::vector<std::unique_ptr<FieldExpr>> rFields;
+  std::vector<FieldExpr *> rFields;
   for (auto fn : ctx->fieldExpr()) {
     visit(fn);
-    rFields.push_back(std::move(visitedFieldExpr));
+    rFields.push_back(visitedFieldExpr);
   }
 
-  visitedExpr = llvm::make_unique<RecordExpr>(std::move(rFields));
+  visitedExpr = make<RecordExpr>(ctx, std::move(rFields));
   return "";
 }
 
 Any TIPtreeBuild::visitFieldExpr(TIPParser::FieldExprContext *ctx) {
-  std::string fName = ctx->IDENTIFIER()->getText();
+  Symbol fName = symbols->intern(ctx->IDENTIFIER()->getText());
   visit(ctx->expr());
   visitedFieldExpr =
-      llvm::make_unique<FieldExpr>(fName, std::move(visitedExpr));
+      make<FieldExpr>(ctx, fName, getFieldIndex(fName), visitedExpr);
   return "";
 }
 
 Any TIPtreeBuild::visitAccessExpr(TIPParser::AccessExprContext *ctx) {
-  std::unique_ptr<Expr> rExpr = nullptr;
-  std::string fName; // will be initialized below based on record expr
+  Expr *rExpr = nullptr;
+  Symbol fName; // will be initialized below based on record expr
 
   // If the base of the access is an identifier, then there will be two
   // elements in the IDENTIFIER vector in this context.
   if (ctx->IDENTIFIER().size() == 2) {
-    std::string rName = ctx->IDENTIFIER(0)->getText();
-    rExpr = llvm::make_unique<VariableExpr>(rName);
+    Symbol rName = symbols->intern(ctx->IDENTIFIER(0)->getText());
+    rExpr = make<VariableExpr>(ctx, rName);
   } else if (ctx->deRefExpr() != nullptr) {
     visit(ctx->deRefExpr());
-    rExpr = std::move(visitedExpr);
+    rExpr = visitedExpr;
   } else if (ctx->parenExpr() != nullptr) {
     visit(ctx->parenExpr());
-    rExpr = std::move(visitedExpr);
+    rExpr = visitedExpr;
   } else {
     // one of these alternative must be defined
     assert(false);
   }
 
-  fName = ctx->IDENTIFIER(ctx->IDENTIFIER().size() - 1)->getText();
+  fName = symbols->intern(
+      ctx->IDENTIFIER(ctx->IDENTIFIER().size() - 1)->getText());
 
-  visitedExpr = llvm::make_unique<AccessExpr>(std::move(rExpr), fName);
+  visitedExpr = make<AccessExpr>(ctx, rExpr, fName, getFieldIndex(fName));
   return "";
 }
 
 Any TIPtreeBuild::visitAssignableExpr(TIPParser::AssignableExprContext *ctx) {
   if (ctx->IDENTIFIER() != nullptr) {
-    std::string aName = ctx->IDENTIFIER()->getText();
-    visitedExpr = llvm::make_unique<VariableExpr>(aName);
+    Symbol aName = symbols->intern(ctx->IDENTIFIER()->getText());
+    visitedExpr = make<VariableExpr>(ctx, aName);
   } else if (ctx->deRefExpr() != nullptr) {
     visit(ctx->deRefExpr());
     // leave visitedExpr from deRefExpr unchanged
@@ -347,79 +353,78 @@ Any TIPtreeBuild::visitAssignableExpr(TIPParser::AssignableExprContext *ctx) {
 }
 
 Any TIPtreeBuild::visitDeclaration(TIPParser::DeclarationContext *ctx) {
-  std::vector<std::string> dVars;
+  std::vector<Symbol> dVars;
   int dLine = -1;
   for (auto id : ctx->IDENTIFIER()) {
     dLine = id->getSymbol()->getLine();
-    dVars.push_back(std::move(id->getText()));
+    dVars.push_back(symbols->intern(id->getText()));
   }
-  visitedDeclStmt = llvm::make_unique<DeclStmt>(std::move(dVars), dLine);
+  visitedDeclStmt = make<DeclStmt>(ctx, std::move(dVars), dLine);
   return "";
 }
 
 Any TIPtreeBuild::visitAssignmentStmt(TIPParser::AssignmentStmtContext *ctx) {
   visit(ctx->assignableExpr());
-  std::unique_ptr<Expr> lhs = std::move(visitedExpr);
+  Expr *lhs = visitedExpr;
   visit(ctx->expr());
-  std::unique_ptr<Expr> rhs = std::move(visitedExpr);
-  visitedStmt = llvm::make_unique<AssignStmt>(std::move(lhs), std::move(rhs));
+  Expr *rhs = visitedExpr;
+  visitedStmt = make<AssignStmt>(ctx, lhs, rhs);
   return "";
 }
 
 Any TIPtreeBuild::visitBlockStmt(TIPParser::BlockStmtContext *ctx) {
-  std::vector<std::unique_ptr<Stmt>> bStmts;
+  std::vector<Stmt *> bStmts;
   for (auto s : ctx->statement()) {
     visit(s);
-    bStmts.push_back(std::move(visitedStmt));
+    bStmts.push_back(visitedStmt);
   }
-  visitedStmt = llvm::make_unique<BlockStmt>(std::move(bStmts));
+  visitedStmt = make<BlockStmt>(ctx, std::move(bStmts));
   return "";
 }
 
 Any TIPtreeBuild::visitWhileStmt(TIPParser::WhileStmtContext *ctx) {
   visit(ctx->expr());
-  std::unique_ptr<Expr> cond = std::move(visitedExpr);
+  Expr *cond = visitedExpr;
 
   visit(ctx->statement());
-  std::unique_ptr<Stmt> body = std::move(visitedStmt);
+  Stmt *body = visitedStmt;
 
-  visitedStmt = llvm::make_unique<WhileStmt>(std::move(cond), std::move(body));
+  visitedStmt = make<WhileStmt>(ctx, cond, body);
   return "";
 }
 
 Any TIPtreeBuild::visitIfStmt(TIPParser::IfStmtContext *ctx) {
   visit(ctx->expr());
-  std::unique_ptr<Expr> cond = std::move(visitedExpr);
+  Expr *cond = visitedExpr;
 
   visit(ctx->statement(0));
-  std::unique_ptr<Stmt> thenBody = std::move(visitedStmt);
+  Stmt *thenBody = visitedStmt;
 
   // else is optional
-  std::unique_ptr<Stmt> elseBody = nullptr;
+  Stmt *elseBody = nullptr;
   if (ctx->statement().size() == 2) {
     visit(ctx->statement(1));
-    elseBody = std::move(visitedStmt);
+    elseBody = visitedStmt;
   }
 
-  visitedStmt = llvm::make_unique<IfStmt>(std::move(cond), std::move(thenBody),
-                                          std::move(elseBody));
+  visitedStmt = make<IfStmt>(ctx, cond, thenBody, elseBody);
   return "";
 }
 
 Any TIPtreeBuild::visitOutputStmt(TIPParser::OutputStmtContext *ctx) {
   visit(ctx->expr());
-  visitedStmt = llvm::make_unique<OutputStmt>(std::move(visitedExpr));
+  visitedStmt = make<OutputStmt>(ctx, visitedExpr);
   return "";
 }
 
 Any TIPtreeBuild::visitErrorStmt(TIPParser::ErrorStmtContext *ctx) {
   visit(ctx->expr());
-  visitedStmt = llvm::make_unique<ErrorStmt>(std::move(visitedExpr));
+  visitedStmt = make<ErrorStmt>(ctx, visitedExpr);
   return "";
 }
 
 Any TIPtreeBuild::visitReturnStmt(TIPParser::ReturnStmtContext *ctx) {
   visit(ctx->expr());
-  visitedStmt = llvm::make_unique<ReturnStmt>(std::move(visitedExpr));
+  visitedStmt = make<ReturnStmt>(ctx, visitedExpr);
   return "";
 }
@@ -10,12 +10,46 @@ using namespace antlrcpp;
 
 class TIPtreeBuild : public TIPBaseVisitor {
 private:
-  TIPParser *parser;
-  std::string opString(int op);
+  std::unique_ptr<TIPtree::AstArena> arena;
+  std::unique_ptr<TIPtree::SymbolTable> symbols;
+  // field index by symbol id, -1 if the symbol is not a field
+  std::vector<int> fieldIndex;
+  std::vector<TIPtree::Symbol> fields;
+  std::vector<TIPtree::Function *> functions;
+  TIPtree::BinaryOp opCode(antlr4::Token *op);
+  int getFieldIndex(TIPtree::Symbol field);
+
+  // Allocate a node located at the start of the rule it is built from
+  template <typename T, typename... Args>
+  T *make(antlr4::ParserRuleContext *ctx, Args &&... args) {
+    T *node = arena->make<T>(std::forward<Args>(args)...);
+    node->line = ctx->getStart()->getLine();
+    node->column = ctx->getStart()->getCharPositionInLine() + 1;
+    return node;
+  }
+
+  /*
+   * Members for communicating information up from visited subtrees
+   * These are overwritten by every visit call.
+   * We use multiple variables here to avoid downcasting the visited nodes.
+   * The nodes themselves are owned by the arena of the Program being built.
+   */
+  TIPtree::Stmt *visitedStmt = nullptr;
+  TIPtree::DeclStmt *visitedDeclStmt = nullptr;
+  TIPtree::Expr *visitedExpr = nullptr;
+  TIPtree::FieldExpr *visitedFieldExpr = nullptr;
+  TIPtree::Function *visitedFunction = nullptr;
 
 public:
-  TIPtreeBuild(TIPParser *parser);
+  TIPtreeBuild() = default;
   std::unique_ptr<TIPtree::Program> build(TIPParser::ProgramContext *ctx);
+  /*
+   * Build a program one function at a time, so that the parse tree of
+   * each function can be freed as soon as its function has been added.
+   */
+  void beginProgram();
+  void addFunction(TIPParser::FunctionContext *ctx);
+  std::unique_ptr<TIPtree::Program> endProgram();
   Any visitFunction(TIPParser::FunctionContext *ctx) override;
   Any visitNegNumber(TIPParser::NegNumberContext *ctx) override;
   Any visitAdditiveExpr(TIPParser::AdditiveExprContext *ctx) override;
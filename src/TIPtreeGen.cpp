@@ -1,4 +1,7 @@
 #include "TIPtreeGen.h"
+#include "UnionFindSolver.h"
+#include "llvm/ProfileData/InstrProf.h"
+#include "llvm/ProfileData/ProfileCommon.h"
 
 using namespace llvm;
 
@@ -19,68 +22,71 @@ namespace TIPtree {
  * dead blocks.
  */
 
-/*
- * These structures records lots of information that spans the codegen()
- * routines.  For example, the current insertion, entry, return blocks
- * in the current function.
- */
-static LLVMContext TheContext;
-static IRBuilder<> Builder(TheContext);
-
-/*
- * This function symbol table stores, for each function, its index
- * and the names of its formal parameters.
- *
- * TBD: It currently relies on the fact that all function parameters are integer
- * type, so we don't need to indicate the type explicitly.  Ultimately, we will
- * want * to record pairs of formals and types here.
- */
-static std::map<std::string, std::pair<int, std::vector<std::string>>>
-    FunctionDecls;
-
-/*
- * This structure stores the mapping from names in a function scope
- * to their LLVM values.  The structure is built when entering a
- * scope and cleared when exiting a scope.
- */
-static std::map<std::string, AllocaInst *> NamedValues;
-
-// Permits getFunction to access the current module being compiled
-static std::unique_ptr<Module> CurrentModule;
-
-/*
- * We use calls to intrinsic for several purposes.  To construct a "nop",
- * using an LLVM internal intrinsic, to perform TIP specific IO, and
- * to allocate heap memory.
- */
-static llvm::Function *nop = nullptr;
-static llvm::Function *inputIntrinsic = nullptr;
-static llvm::Function *outputIntrinsic = nullptr;
-static llvm::Function *errorIntrinsic = nullptr;
-static llvm::Function *mallocFun = nullptr;
+Type *CodegenContext::lowerType(TIPtype *type) {
+  if (auto *ref = dyn_cast<TIPref>(type)) {
+    return PointerType::get(lowerType(ref->of), 0);
+  }
+  if (isa<TIPrecord>(type)) {
+    return Type::getInt64PtrTy(TheContext);
+  }
+  // ints, function indices and values of unknown type
+  return Type::getInt64Ty(TheContext);
+}
 
-// A counter to create unique labels
-static int labelNum = 0;
+Type *CodegenContext::getNodeType(int id) {
+  if (typeSolver == nullptr) {
+    return Type::getInt64Ty(TheContext);
+  }
+  return lowerType(typeSolver->getType(id));
+}
 
-// Indicate whether the expression code gen is for an L-value
-static bool lValueGen = false;
+// The signature of a function of the given type and arity
+FunctionType *CodegenContext::getSignature(int id, size_t arity) {
+  std::vector<Type *> paramTypes(arity, Type::getInt64Ty(TheContext));
+  Type *retType = Type::getInt64Ty(TheContext);
+  if (typeSolver != nullptr) {
+    auto *fun = dyn_cast<TIPfun>(typeSolver->getType(id));
+    if (fun != nullptr && fun->param_types.size() == arity) {
+      for (size_t i = 0; i < arity; i++) {
+        paramTypes[i] = lowerType(fun->param_types[i]);
+      }
+      retType = lowerType(fun->ret);
+    }
+  }
+  return FunctionType::get(retType, paramTypes, false);
+}
 
-/*
- * The global function dispatch table is created in a shallow pass over
- * the function signatures, stored here, and then referenced in generating
- * function applications.
- */
-static GlobalVariable *tipFTable = nullptr;
+// Convert between integers, booleans and pointers of any type
+Value *CodegenContext::coerce(Value *V, Type *T) {
+  if (V->getType() == T) {
+    return V;
+  }
+  if (V->getType()->isIntegerTy(1)) {
+    V = Builder.CreateZExt(V, Type::getInt64Ty(TheContext), "booltmp");
+    if (V->getType() == T) {
+      return V;
+    }
+  }
+  if (V->getType()->isPointerTy()) {
+    return T->isPointerTy() ? Builder.CreatePointerCast(V, T, "castPtr")
+                            : Builder.CreatePtrToInt(V, T, "intPtrVal");
+  }
+  return Builder.CreateIntToPtr(V, T, "ptrIntVal");
+}
 
-// The number of TIP program parameters
-static int numTIPArgs = 0;
+void CodegenContext::bindNamedValue(Symbol name, AllocaInst *alloca) {
+  if (NamedValues[name.id] == nullptr) {
+    NamedSymbols.push_back(name.id);
+  }
+  NamedValues[name.id] = alloca;
+}
 
-/*
- * The global argument count and array are used to communicate command
- * line inputs to the TIP main function.
- */
-static GlobalVariable *tipNumInputs = nullptr;
-static GlobalVariable *tipInputArray = nullptr;
+void CodegenContext::clearNamedValues() {
+  for (int sym : NamedSymbols) {
+    NamedValues[sym] = nullptr;
+  }
+  NamedSymbols.clear();
+}
 
 /*
  * Create LLVM Function in Module associated with current program.
@@ -88,16 +94,16 @@ static GlobalVariable *tipInputArray = nullptr;
  * This is a key element of the shallow pass that builds the function
  * dispatch table.
  */
-static llvm::Function *getFunction(std::string Name) {
+llvm::Function *CodegenContext::getFunction(Symbol Name) {
   // Lookup the symbol to access the formal parameter list
-  auto idx_formals = FunctionDecls[Name];
+  auto &idx_formals = FunctionDecls[Name.id];
 
   /*
    * Main is handled specially.  It is declared as "_tip_main" with
    * no arguments - any arguments are converted to locals with special
    * initializaton in Function::codegen().
    */
-  if (Name == "main") {
+  if (Name.id == mainSymbol) {
     if (auto *M = CurrentModule->getFunction("_tip_main")) {
       return M;
     }
@@ -108,28 +114,22 @@ static llvm::Function *getFunction(std::string Name) {
     // Declare "_tip_main()"
     auto *M = llvm::Function::Create(
         FunctionType::get(Type::getInt64Ty(TheContext), false),
-        llvm::Function::ExternalLinkage, "_tip_" + Name, CurrentModule.get());
+        llvm::Function::ExternalLinkage, "_tip_main", CurrentModule.get());
     return M;
   } else {
     // check if function is in the current module
-    if (auto *F = CurrentModule->getFunction(Name)) {
+    if (auto *F = CurrentModule->getFunction(Name.name)) {
       return F;
     }
 
-    std::vector<Type *> FormalTypes(idx_formals.second.size(),
-                                    Type::getInt64Ty(TheContext));
-
-    // Use type factory to create function from formal type to int
-    auto *FT =
-        FunctionType::get(Type::getInt64Ty(TheContext), FormalTypes, false);
-
-    auto *F = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, Name,
-                                     CurrentModule.get());
+    auto *F = llvm::Function::Create(FunctionSigs[idx_formals.first],
+                                     llvm::Function::ExternalLinkage,
+                                     Name.name, CurrentModule.get());
 
     // assign names to args for readability of generated code
     unsigned i = 0;
     for (auto &param : F->args()) {
-      param.setName(idx_formals.second[i++]);
+      param.setName(idx_formals.second[i++].name);
     }
 
     return F;
@@ -140,11 +140,298 @@ static llvm::Function *getFunction(std::string Name) {
  * Create an alloca instruction in the entry block of the function.
  * This is used for mutable variables, including arguments to functions.
  */
-static AllocaInst *CreateEntryBlockAlloca(llvm::Function *TheFunction,
-                                          const std::string &VarName) {
+AllocaInst *CodegenContext::CreateEntryBlockAlloca(llvm::Function *TheFunction,
+                                                   StringRef VarName, Type *T) {
   IRBuilder<> TmpB(&TheFunction->getEntryBlock(),
                    TheFunction->getEntryBlock().begin());
-  return TmpB.CreateAlloca(Type::getInt64Ty(TheContext), 0, VarName);
+  AllocaInst *alloca = TmpB.CreateAlloca(T, 0, VarName);
+  if (gcEnabled) {
+    gcRoots.push_back(alloca);
+  }
+  return alloca;
+}
+
+/*
+ * Keep a value that may be a heap reference alive until the function
+ * returns.  The results of allocations and calls are only held in
+ * registers, so when another allocation in the same expression triggers
+ * a collection they must be visible to the collector.
+ */
+void CodegenContext::CreateTemporaryRoot(Value *V) {
+  if (gcEnabled) {
+    llvm::Function *TheFunction = Builder.GetInsertBlock()->getParent();
+    Builder.CreateStore(
+        V, CreateEntryBlockAlloca(TheFunction, "gcroot", V->getType()));
+  }
+}
+
+/*
+ * Link a frame holding the addresses of all of the function's stack slots
+ * into the shadow stack on entry, and unlink it before each return.  This
+ * is done once the body is generated, so that every slot is known, and
+ * all of the slots are cleared before the frame is linked.
+ */
+void CodegenContext::CreateGCFrame(llvm::Function *TheFunction) {
+  if (gcRoots.empty()) {
+    return;
+  }
+
+  auto *rootsType =
+      ArrayType::get(Type::getInt64PtrTy(TheContext), gcRoots.size());
+  auto *frameType = StructType::get(
+      TheContext,
+      {Type::getInt8PtrTy(TheContext), Type::getInt64Ty(TheContext),
+       rootsType});
+
+  BasicBlock &entry = TheFunction->getEntryBlock();
+  IRBuilder<> TmpB(&entry, entry.begin());
+  AllocaInst *frame = TmpB.CreateAlloca(frameType, nullptr, "gcframe");
+
+  // the frame is linked before the first non-alloca instruction
+  auto insertPt = entry.begin();
+  while (isa<AllocaInst>(*insertPt)) {
+    ++insertPt;
+  }
+  TmpB.SetInsertPoint(&entry, insertPt);
+
+  Value *roots = TmpB.CreateStructGEP(frameType, frame, 2, "gcroots");
+  for (size_t r = 0; r < gcRoots.size(); r++) {
+    TmpB.CreateStore(Constant::getNullValue(gcRoots[r]->getAllocatedType()),
+                     gcRoots[r]);
+    TmpB.CreateStore(
+        TmpB.CreatePointerCast(gcRoots[r], Type::getInt64PtrTy(TheContext)),
+        TmpB.CreateConstInBoundsGEP2_32(rootsType, roots, 0, r));
+  }
+  TmpB.CreateStore(TmpB.CreateLoad(tipGCFrames, "gcprev"),
+                   TmpB.CreateStructGEP(frameType, frame, 0));
+  TmpB.CreateStore(
+      ConstantInt::get(Type::getInt64Ty(TheContext), gcRoots.size()),
+      TmpB.CreateStructGEP(frameType, frame, 1));
+  TmpB.CreateStore(
+      TmpB.CreatePointerCast(frame, Type::getInt8PtrTy(TheContext)),
+      tipGCFrames);
+
+  for (auto &BB : *TheFunction) {
+    if (auto *ret = dyn_cast_or_null<ReturnInst>(BB.getTerminator())) {
+      TmpB.SetInsertPoint(ret);
+      TmpB.CreateStore(
+          TmpB.CreateLoad(TmpB.CreateStructGEP(frameType, frame, 0), "gcprev"),
+          tipGCFrames);
+    }
+  }
+}
+
+// Number n counters, returning the number of the first
+unsigned CodegenContext::CreateProfileCounters(unsigned n) {
+  unsigned first = numCounters;
+  numCounters += n;
+  return first;
+}
+
+// The count of a counter in the profile being used, 0 if there is none
+uint64_t CodegenContext::getProfileCount(unsigned counter) {
+  if (profile == nullptr || profile->mode != TIPprofile::Use ||
+      counter >= profile->counts.size()) {
+    return 0;
+  }
+  return profile->counts[counter];
+}
+
+// Count the execution of the insertion point when collecting a profile
+void CodegenContext::CreateProfileIncrement(unsigned counter) {
+  if (profile == nullptr || profile->mode != TIPprofile::Generate) {
+    return;
+  }
+  if (tipProfCounters == nullptr) {
+    tipProfCounters = new GlobalVariable(
+        *CurrentModule, ArrayType::get(Type::getInt64Ty(TheContext), 0),
+        false, llvm::GlobalValue::ExternalLinkage, nullptr,
+        "_tip_prof_counters");
+  }
+  // the placeholder is empty, so the address is not inbounds
+  Value *slot =
+      Builder.CreateConstGEP2_64(tipProfCounters, 0, counter, "profslot");
+  Value *count = Builder.CreateLoad(slot, "profcount");
+  Builder.CreateStore(
+      Builder.CreateAdd(count, ConstantInt::get(count->getType(), 1)), slot);
+}
+
+/*
+ * Weight the edges of a conditional branch by the counts of the counter
+ * and the next one, which count the true and the false edge.  Weights
+ * are 32 bits so large counts are scaled down, and one is added so that
+ * an edge that was never taken is unlikely rather than impossible.
+ */
+void CodegenContext::setBranchWeights(BranchInst *BI, unsigned counter) {
+  uint64_t trueCount = getProfileCount(counter);
+  uint64_t falseCount = getProfileCount(counter + 1);
+  if (trueCount == 0 && falseCount == 0) {
+    return;
+  }
+  uint64_t scale = std::max(trueCount, falseCount) / UINT32_MAX + 1;
+  MDBuilder MDB(TheContext);
+  BI->setMetadata(LLVMContext::MD_prof,
+                  MDB.createBranchWeights(trueCount / scale + 1,
+                                          falseCount / scale + 1));
+}
+
+/*
+ * Set the entry count of a function from its first counter, which is
+ * followed by the counters of its body.
+ */
+void CodegenContext::setFunctionProfile(llvm::Function *TheFunction,
+                                        unsigned counter) {
+  if (profile == nullptr || profile->mode != TIPprofile::Use) {
+    return;
+  }
+  std::vector<uint64_t> counts;
+  for (unsigned c = counter; c < numCounters; c++) {
+    counts.push_back(getProfileCount(c));
+  }
+  TheFunction->setEntryCount(counts[0]);
+  profileRecords.push_back(std::move(counts));
+}
+
+/*
+ * Define the counters and the globals that describe them for the
+ * intrinsics, or summarize the profile being used so that the optimizer
+ * can tell which functions and blocks are hot.
+ */
+void CodegenContext::finishProfile() {
+  if (profile == nullptr || profile->mode == TIPprofile::None) {
+    return;
+  }
+
+  if (profile->mode == TIPprofile::Use) {
+    InstrProfSummaryBuilder summary(ProfileSummaryBuilder::DefaultCutoffs);
+    for (auto &counts : profileRecords) {
+      summary.addRecord(InstrProfRecord(counts));
+    }
+    CurrentModule->setProfileSummary(summary.getSummary()->getMD(TheContext));
+    return;
+  }
+
+  auto *Int64 = Type::getInt64Ty(TheContext);
+  auto *countersType = ArrayType::get(Int64, numCounters);
+  auto *counters = new GlobalVariable(
+      *CurrentModule, countersType, false, llvm::GlobalValue::ExternalLinkage,
+      ConstantAggregateZero::get(countersType));
+  if (tipProfCounters != nullptr) {
+    counters->takeName(tipProfCounters);
+    tipProfCounters->replaceAllUsesWith(
+        ConstantExpr::getBitCast(counters, tipProfCounters->getType()));
+    tipProfCounters->eraseFromParent();
+  } else {
+    counters->setName("_tip_prof_counters");
+  }
+  tipProfCounters = counters;
+
+  new GlobalVariable(*CurrentModule, Int64, true,
+                     llvm::GlobalValue::ExternalLinkage,
+                     ConstantInt::get(Int64, numCounters),
+                     "_tip_prof_num_counters");
+  new GlobalVariable(*CurrentModule, Int64, true,
+                     llvm::GlobalValue::ExternalLinkage,
+                     ConstantInt::get(Int64, profile->hash), "_tip_prof_hash");
+}
+
+/*
+ * Report the entry to the function, once its stack slots are allocated,
+ * and each of its returns to the profiler.
+ */
+void CodegenContext::CreateInstrumentation(llvm::Function *TheFunction,
+                                           int funIndex) {
+  BasicBlock &entry = TheFunction->getEntryBlock();
+  auto insertPt = entry.begin();
+  while (isa<AllocaInst>(*insertPt)) {
+    ++insertPt;
+  }
+  IRBuilder<> TmpB(&entry, insertPt);
+  TmpB.CreateCall(instrEnterIntrinsic,
+                  ConstantInt::get(Type::getInt64Ty(TheContext), funIndex));
+
+  for (auto &BB : *TheFunction) {
+    if (auto *ret = dyn_cast_or_null<ReturnInst>(BB.getTerminator())) {
+      TmpB.SetInsertPoint(ret);
+      TmpB.CreateCall(instrExitIntrinsic);
+    }
+  }
+}
+
+// Record the load or store of the locations of the node for its class
+void CodegenContext::setAliasClass(Instruction *I, int id) {
+  if (id > 0 && id < (int)aliasClasses.size() && aliasClasses[id] != -1) {
+    aliasAccesses.emplace_back(I, aliasClasses[id]);
+  }
+}
+
+/*
+ * The noalias list of each class names every other class of the function,
+ * so the metadata grows with the square of the number of classes and only
+ * the classes that are accessed most often are annotated.
+ */
+static const size_t maxFunctionAliasClasses = 64;
+
+// Annotate the recorded loads and stores of the function being generated
+void CodegenContext::setAliasScopes() {
+  std::vector<int> accessClasses;
+  for (auto &access : aliasAccesses) {
+    accessClasses.push_back(access.second);
+  }
+  std::sort(accessClasses.begin(), accessClasses.end());
+  std::vector<std::pair<size_t, int>> classCounts;
+  for (size_t i = 0; i < accessClasses.size();) {
+    size_t j = i;
+    while (j < accessClasses.size() && accessClasses[j] == accessClasses[i]) {
+      j++;
+    }
+    classCounts.emplace_back(j - i, accessClasses[i]);
+    i = j;
+  }
+  std::sort(classCounts.rbegin(), classCounts.rend());
+  if (classCounts.size() > maxFunctionAliasClasses) {
+    classCounts.resize(maxFunctionAliasClasses);
+  }
+
+  // the accesses of a single class may all alias each other
+  if (classCounts.size() > 1) {
+    MDBuilder MDB(TheContext);
+    if (aliasDomain == nullptr) {
+      aliasDomain = MDB.createAliasScopeDomain("tip.points-to");
+    }
+    std::vector<Metadata *> scopes;
+    std::map<int, size_t> scopeIndex;
+    for (auto &classCount : classCounts) {
+      int aliasClass = classCount.second;
+      if (aliasClass >= (int)aliasScopes.size()) {
+        aliasScopes.resize(aliasClass + 1, nullptr);
+      }
+      if (aliasScopes[aliasClass] == nullptr) {
+        aliasScopes[aliasClass] = MDB.createAliasScope(
+            "tip.points-to." + std::to_string(aliasClass), aliasDomain);
+      }
+      scopeIndex[aliasClass] = scopes.size();
+      scopes.push_back(aliasScopes[aliasClass]);
+    }
+
+    std::vector<MDNode *> scopeLists, noaliasLists;
+    for (size_t i = 0; i < scopes.size(); i++) {
+      std::vector<Metadata *> others(scopes.begin(), scopes.begin() + i);
+      others.insert(others.end(), scopes.begin() + i + 1, scopes.end());
+      scopeLists.push_back(MDNode::get(TheContext, scopes[i]));
+      noaliasLists.push_back(MDNode::get(TheContext, others));
+    }
+    for (auto &access : aliasAccesses) {
+      auto index = scopeIndex.find(access.second);
+      if (index != scopeIndex.end()) {
+        access.first->setMetadata(LLVMContext::MD_alias_scope,
+                                  scopeLists[index->second]);
+        access.first->setMetadata(LLVMContext::MD_noalias,
+                                  noaliasLists[index->second]);
+      }
+    }
+  }
+  aliasAccesses.clear();
 }
 
 static Value *LogError(std::string s) {
@@ -154,17 +441,59 @@ static Value *LogError(std::string s) {
 
 /********************* codegen() routines ************************/
 
-std::unique_ptr<llvm::Module> Program::codegen(std::string programName) {
+std::unique_ptr<llvm::Module> Program::codegen(LLVMContext &TheContext,
+                                               std::string programName,
+                                               const CodegenOptions &options) {
   // Create module to hold generated code
   auto TheModule = llvm::make_unique<Module>(programName, TheContext);
 
+  // All of the codegen state for this program lives in its context
+  CodegenContext ctx(TheContext, options);
+  if (ctx.instrument) {
+    std::vector<Type *> oneInt(1, Type::getInt64Ty(TheContext));
+    ctx.instrEnterIntrinsic = llvm::Function::Create(
+        FunctionType::get(Type::getVoidTy(TheContext), oneInt, false),
+        llvm::Function::ExternalLinkage, "_tip_instr_enter", TheModule.get());
+    ctx.instrEnterIntrinsic->addFnAttr(llvm::Attribute::NoUnwind);
+    ctx.instrEnterIntrinsic->addFnAttr(llvm::Attribute::InaccessibleMemOnly);
+    ctx.instrExitIntrinsic = llvm::Function::Create(
+        FunctionType::get(Type::getVoidTy(TheContext), false),
+        llvm::Function::ExternalLinkage, "_tip_instr_exit", TheModule.get());
+    ctx.instrExitIntrinsic->addFnAttr(llvm::Attribute::NoUnwind);
+    ctx.instrExitIntrinsic->addFnAttr(llvm::Attribute::InaccessibleMemOnly);
+  }
+  if (ctx.gcEnabled) {
+    std::vector<Type *> oneInt(1, Type::getInt64Ty(TheContext));
+    auto *FT = FunctionType::get(Type::getInt8PtrTy(TheContext), oneInt, false);
+    ctx.gcAllocIntrinsic = llvm::Function::Create(
+        FT, llvm::Function::ExternalLinkage, "_tip_gc_alloc", TheModule.get());
+    ctx.gcAllocIntrinsic->addFnAttr(llvm::Attribute::NoUnwind);
+    ctx.gcAllocIntrinsic->addAttribute(0, llvm::Attribute::NoAlias);
+
+    ctx.tipGCFrames = new GlobalVariable(
+        *TheModule, Type::getInt8PtrTy(TheContext), false,
+        llvm::GlobalValue::ExternalLinkage, nullptr, "_tip_gc_frames");
+  }
+
   // Initialize nop declaration
-  nop = Intrinsic::getDeclaration(TheModule.get(), Intrinsic::donothing);
+  ctx.nop = Intrinsic::getDeclaration(TheModule.get(), Intrinsic::donothing);
 
-  labelNum = 0;
+  ctx.numRecordFields = FIELDS.size();
+  if (options.aliasScopes) {
+    ctx.aliasClasses = findAliasClasses();
+  }
+  if (options.stackAllocs) {
+    ctx.stackAllocs = findStackAllocs();
+  }
+
+  // Size the symbol indexed tables for this program
+  ctx.FunctionDecls.assign(SYMBOLS->size(),
+                           std::make_pair(-1, std::vector<Symbol>()));
+  ctx.NamedValues.assign(SYMBOLS->size(), nullptr);
+  ctx.mainSymbol = SYMBOLS->lookup("main").id;
 
   // Transfer the module for access by shared codegen routines
-  CurrentModule = std::move(TheModule);
+  ctx.CurrentModule = std::move(TheModule);
 
   /*
    * This shallow pass over the function declarations builds the
@@ -178,9 +507,11 @@ std::unique_ptr<llvm::Module> Program::codegen(std::string programName) {
      */
     int funIndex = 0;
     for (auto const &fn : FUNCTIONS) {
-      std::pair<int, std::vector<std::string>> thePair(funIndex++,
-                                                       fn->getFormals());
-      FunctionDecls[fn->getName()] = thePair;
+      std::pair<int, std::vector<Symbol>> thePair(funIndex++,
+                                                  fn->getFormals());
+      ctx.FunctionDecls[fn->getName().id] = thePair;
+      ctx.FunctionSigs.push_back(
+          ctx.getSignature(fn->getId(), fn->getFormals().size()));
     }
 
     /*
@@ -192,7 +523,7 @@ std::unique_ptr<llvm::Module> Program::codegen(std::string programName) {
      */
     std::vector<llvm::Constant *> programFunctions;
     for (auto const &fn : FUNCTIONS) {
-      programFunctions.push_back(getFunction(fn->getName()));
+      programFunctions.push_back(ctx.getFunction(fn->getName()));
     }
 
     /*
@@ -220,9 +551,40 @@ std::unique_ptr<llvm::Module> Program::codegen(std::string programName) {
     auto *ftableInit = ConstantArray::get(ftableType, castProgramFunctions);
 
     // Create the global function dispatch table
-    tipFTable = new GlobalVariable(*CurrentModule, ftableType, true,
-                                   llvm::GlobalValue::InternalLinkage,
-                                   ftableInit, "_tip_ftable");
+    ctx.tipFTable = new GlobalVariable(*ctx.CurrentModule, ftableType, true,
+                                       llvm::GlobalValue::InternalLinkage,
+                                       ftableInit, "_tip_ftable");
+
+    if (options.memoize) {
+      std::vector<bool> pure = findPureFunctions();
+      for (auto const &fn : FUNCTIONS) {
+        ctx.memoized.push_back(pure[fn->getName().id]);
+      }
+    }
+
+    // The profiler reports functions by the names in this table
+    if (ctx.instrument) {
+      auto *namePtrType = Type::getInt8PtrTy(TheContext);
+      std::vector<Constant *> names;
+      for (auto const &fn : FUNCTIONS) {
+        auto *name = ConstantDataArray::getString(TheContext,
+                                                  fn->getName().name);
+        auto *nameVar = new GlobalVariable(
+            *ctx.CurrentModule, name->getType(), true,
+            llvm::GlobalValue::PrivateLinkage, name, "_tip_instr_name");
+        names.push_back(ConstantExpr::getPointerCast(nameVar, namePtrType));
+      }
+      auto *namesType = ArrayType::get(namePtrType, funIndex);
+      new GlobalVariable(*ctx.CurrentModule, namesType, true,
+                         llvm::GlobalValue::ExternalLinkage,
+                         ConstantArray::get(namesType, names),
+                         "_tip_instr_names");
+      new GlobalVariable(
+          *ctx.CurrentModule, Type::getInt64Ty(TheContext), true,
+          llvm::GlobalValue::ExternalLinkage,
+          ConstantInt::get(Type::getInt64Ty(TheContext), funIndex),
+          "_tip_instr_num_functions");
+    }
   }
 
   /*
@@ -238,118 +600,146 @@ std::unique_ptr<llvm::Module> Program::codegen(std::string programName) {
      * we never visit it during the codegen() traversals - since
      * the function doesn't exist in the TIP program.
      */
-    auto fd = FunctionDecls.find("main");
-    if (fd == FunctionDecls.end()) {
+    if (ctx.mainSymbol == -1 || ctx.FunctionDecls[ctx.mainSymbol].first == -1) {
       auto *M = llvm::Function::Create(
           FunctionType::get(Type::getInt64Ty(TheContext), false),
-          llvm::Function::ExternalLinkage, "_tip_main", CurrentModule.get());
+          llvm::Function::ExternalLinkage, "_tip_main",
+          ctx.CurrentModule.get());
       BasicBlock *BB = BasicBlock::Create(TheContext, "entry", M);
-      Builder.SetInsertPoint(BB);
+      ctx.Builder.SetInsertPoint(BB);
 
       auto *undef = llvm::Function::Create(
           FunctionType::get(Type::getVoidTy(TheContext), false),
           llvm::Function::ExternalLinkage, "_tip_main_undefined",
-          CurrentModule.get());
-      Builder.CreateCall(undef);
-      Builder.CreateRet(ConstantInt::get(Type::getInt64Ty(TheContext), 0));
+          ctx.CurrentModule.get());
+      undef->addFnAttr(llvm::Attribute::NoUnwind);
+      undef->addFnAttr(llvm::Attribute::NoReturn);
+      undef->addFnAttr(llvm::Attribute::Cold);
+      ctx.Builder.CreateCall(undef);
+      ctx.Builder.CreateRet(ConstantInt::get(Type::getInt64Ty(TheContext), 0));
     }
 
     // create global _tip_num_inputs with init of numTIPArgs
-    tipNumInputs = new GlobalVariable(
-        *CurrentModule, Type::getInt64Ty(TheContext), true,
+    ctx.tipNumInputs = new GlobalVariable(
+        *ctx.CurrentModule, Type::getInt64Ty(TheContext), true,
         llvm::GlobalValue::ExternalLinkage,
-        ConstantInt::get(Type::getInt64Ty(TheContext), numTIPArgs),
+        ConstantInt::get(Type::getInt64Ty(TheContext), ctx.numTIPArgs),
         "_tip_num_inputs");
 
     // create global _tip_input_array with up to numTIPArgs of Int64
     auto *inputArrayType =
-        ArrayType::get(Type::getInt64Ty(TheContext), numTIPArgs);
+        ArrayType::get(Type::getInt64Ty(TheContext), ctx.numTIPArgs);
     std::vector<Constant *> zeros(
-        numTIPArgs, ConstantInt::get(Type::getInt64Ty(TheContext), 0));
-    tipInputArray = new GlobalVariable(
-        *CurrentModule, inputArrayType, false, llvm::GlobalValue::CommonLinkage,
+        ctx.numTIPArgs, ConstantInt::get(Type::getInt64Ty(TheContext), 0));
+    ctx.tipInputArray = new GlobalVariable(
+        *ctx.CurrentModule, inputArrayType, false,
+        llvm::GlobalValue::CommonLinkage,
         ConstantArray::get(inputArrayType, zeros), "_tip_input_array");
   }
 
   // Code is generated into the module by the other routines
   for (auto const &fn : FUNCTIONS) {
-    fn->codegen();
+    fn->codegen(&ctx);
   }
+  ctx.finishProfile();
 
-  TheModule = std::move(CurrentModule);
+  TheModule = std::move(ctx.CurrentModule);
 
   verifyModule(*TheModule);
 
   return TheModule;
 }
 
-llvm::Function *Function::codegen() {
+llvm::Function *Function::codegen(CodegenContext *ctx) {
   bool success = true;
 
-  llvm::Function *TheFunction = getFunction(getName());
+  llvm::Function *TheFunction = ctx->getFunction(getName());
   if (TheFunction == nullptr) {
     return nullptr;
   }
 
   // create basic block to hold body of function definition
-  BasicBlock *BB = BasicBlock::Create(TheContext, "entry", TheFunction);
-  Builder.SetInsertPoint(BB);
+  BasicBlock *BB = BasicBlock::Create(ctx->TheContext, "entry", TheFunction);
+  ctx->Builder.SetInsertPoint(BB);
+
+  // count the calls of the function
+  unsigned counter = ctx->CreateProfileCounters(1);
+  ctx->CreateProfileIncrement(counter);
 
   // keep scope separate from prior definitions
-  NamedValues.clear();
+  ctx->clearNamedValues();
+  ctx->gcRoots.clear();
+  ctx->aliasAccesses.clear();
 
   /*
    * Add arguments to the symbol table
    *   - for main function, we initialize allocas with intrinsic array loads
    *   - for other functions, we initialize allocas with the arg values
    */
-  if (getName() == "main") {
+  if (getName().id == ctx->mainSymbol) {
     int argIdx = 0;
     // Note that the args are not in the LLVM function decl, so we use the AST
     // formals
     for (auto &argName : getFormals()) {
       // Create an alloca for this argument and store its value
-      AllocaInst *argAlloc = CreateEntryBlockAlloca(TheFunction, argName);
+      AllocaInst *argAlloc = ctx->CreateEntryBlockAlloca(
+          TheFunction, argName.name, ctx->getNodeType(FORMAL_IDS[argIdx]));
 
       // Emit the GEP instruction to index into input array
       std::vector<Value *> indices;
-      indices.push_back(ConstantInt::get(Type::getInt64Ty(TheContext), 0));
-      indices.push_back(ConstantInt::get(Type::getInt64Ty(TheContext), argIdx));
-      auto *gep = Builder.CreateInBoundsGEP(tipInputArray, indices, "inputidx");
+      indices.push_back(ConstantInt::get(Type::getInt64Ty(ctx->TheContext), 0));
+      indices.push_back(
+          ConstantInt::get(Type::getInt64Ty(ctx->TheContext), argIdx));
+      auto *gep = ctx->Builder.CreateInBoundsGEP(ctx->tipInputArray, indices,
+                                                 "inputidx");
 
       // Load the value and store it into the arg's alloca
       auto *inVal =
-          Builder.CreateLoad(gep, "tipinput" + std::to_string(argIdx++));
-      Builder.CreateStore(inVal, argAlloc);
+          ctx->Builder.CreateLoad(gep, "tipinput" + std::to_string(argIdx++));
+      ctx->Builder.CreateStore(
+          ctx->coerce(inVal, argAlloc->getAllocatedType()), argAlloc);
 
       // Record name binding to alloca
-      NamedValues[argName] = argAlloc;
+      ctx->bindNamedValue(argName, argAlloc);
     }
   } else {
+    // The LLVM args are in the same order as the AST formals
+    auto formal = getFormals().begin();
     for (auto &arg : TheFunction->args()) {
       // Create an alloca for this argument and store its value
-      AllocaInst *argAlloc = CreateEntryBlockAlloca(TheFunction, arg.getName());
-      Builder.CreateStore(&arg, argAlloc);
+      AllocaInst *argAlloc =
+          ctx->CreateEntryBlockAlloca(TheFunction, formal->name, arg.getType());
+      ctx->Builder.CreateStore(&arg, argAlloc);
 
       // Record name binding to alloca
-      NamedValues[arg.getName()] = argAlloc;
+      ctx->bindNamedValue(*formal++, argAlloc);
     }
   }
 
   // add local declarations to the symbol table
   for (auto const &decl : DECLS) {
-    if (decl->codegen() == nullptr) {
+    if (decl->codegen(ctx) == nullptr) {
       success = false;
     }
   }
 
   for (auto &stmt : BODY) {
-    if (stmt->codegen() == nullptr) {
+    if (stmt->codegen(ctx) == nullptr) {
       success = false;
     }
   }
 
   if (success) {
+    if (ctx->gcEnabled) {
+      ctx->CreateGCFrame(TheFunction);
+    }
+    ctx->setFunctionProfile(TheFunction, counter);
+    ctx->setAliasScopes();
+    if (ctx->instrument) {
+      ctx->CreateInstrumentation(TheFunction,
+                                 ctx->FunctionDecls[getName().id].first);
+    }
+
     // internal LLVM helper function to detect errors in function defs
     verifyFunction(*TheFunction);
     return TheFunction;
@@ -360,31 +750,36 @@ llvm::Function *Function::codegen() {
   return nullptr;
 }
 
-llvm::Value *NumberExpr::codegen() {
-  return ConstantInt::get(Type::getInt64Ty(TheContext), VAL);
+llvm::Value *NumberExpr::codegen(CodegenContext *ctx) {
+  return ConstantInt::get(Type::getInt64Ty(ctx->TheContext), VAL);
 }
 
-llvm::Value *BinaryExpr::codegen() {
-  Value *L = LHS->codegen();
-  Value *R = RHS->codegen();
+llvm::Value *BinaryExpr::codegen(CodegenContext *ctx) {
+  Value *L = LHS->codegen(ctx);
+  Value *R = RHS->codegen(ctx);
   if (L == nullptr || R == nullptr) {
     return nullptr;
   }
-
-  if (OP == "+") {
-    return Builder.CreateAdd(L, R, "addtmp");
-  } else if (OP == "-") {
-    return Builder.CreateSub(L, R, "subtmp");
-  } else if (OP == "*") {
-    return Builder.CreateMul(L, R, "multmp");
-  } else if (OP == "/") {
-    return Builder.CreateSDiv(L, R, "divtmp");
-  } else if (OP == ">") {
-    return Builder.CreateICmpSGT(L, R, "gttmp");
-  } else if (OP == "==") {
-    return Builder.CreateICmpEQ(L, R, "eqtmp");
-  } else {
-    return LogError("Invalid binary operator: " + OP);
+  L = ctx->coerce(L, Type::getInt64Ty(ctx->TheContext));
+  R = ctx->coerce(R, Type::getInt64Ty(ctx->TheContext));
+
+  switch (OP) {
+  case OpAdd:
+    return ctx->Builder.CreateAdd(L, R, "addtmp");
+  case OpSub:
+    return ctx->Builder.CreateSub(L, R, "subtmp");
+  case OpMul:
+    return ctx->Builder.CreateMul(L, R, "multmp");
+  case OpDiv:
+    return ctx->Builder.CreateSDiv(L, R, "divtmp");
+  case OpGt:
+    return ctx->coerce(ctx->Builder.CreateICmpSGT(L, R, "gttmp"),
+                       Type::getInt64Ty(ctx->TheContext));
+  case OpEq:
+    return ctx->coerce(ctx->Builder.CreateICmpEQ(L, R, "eqtmp"),
+                       Type::getInt64Ty(ctx->TheContext));
+  default:
+    return LogError("Invalid binary operator: " + print());
   }
 }
 
@@ -394,31 +789,37 @@ llvm::Value *BinaryExpr::codegen() {
  *
  * This relies on the fact that TIP programs do not permit duplicate names.
  */
-llvm::Value *VariableExpr::codegen() {
-  auto nv = NamedValues.find(NAME);
-  if (nv != NamedValues.end()) {
-    if (lValueGen) {
-      return NamedValues[nv->first];
+llvm::Value *VariableExpr::codegen(CodegenContext *ctx) {
+  AllocaInst *nv = ctx->NamedValues[NAME.id];
+  if (nv != nullptr) {
+    if (ctx->lValueGen) {
+      return nv;
     } else {
-      return Builder.CreateLoad(nv->second, NAME.c_str());
+      auto *load = ctx->Builder.CreateLoad(nv, NAME.name);
+      ctx->setAliasClass(load, getId());
+      return load;
     }
   }
 
-  auto fd = FunctionDecls.find(NAME);
-  if (fd == FunctionDecls.end()) {
-    return LogError("Unknown variable name: " + NAME);
+  int funIndex = ctx->FunctionDecls[NAME.id].first;
+  if (funIndex == -1) {
+    return LogError("Unknown variable name: " + NAME.str());
   }
 
-  return ConstantInt::get(Type::getInt64Ty(TheContext), (fd->second).first);
+  return ConstantInt::get(Type::getInt64Ty(ctx->TheContext), funIndex);
 }
 
-llvm::Value *InputExpr::codegen() {
-  if (inputIntrinsic == nullptr) {
-    auto *FT = FunctionType::get(Type::getInt64Ty(TheContext), false);
-    inputIntrinsic = llvm::Function::Create(FT, llvm::Function::ExternalLinkage,
-                                            "_tip_input", CurrentModule.get());
+llvm::Value *InputExpr::codegen(CodegenContext *ctx) {
+  if (ctx->inputIntrinsic == nullptr) {
+    auto *FT = FunctionType::get(Type::getInt64Ty(ctx->TheContext), false);
+    ctx->inputIntrinsic =
+        llvm::Function::Create(FT, llvm::Function::ExternalLinkage,
+                               "_tip_input", ctx->CurrentModule.get());
+    // IO only touches the state of the intrinsics and of the C library
+    ctx->inputIntrinsic->addFnAttr(llvm::Attribute::NoUnwind);
+    ctx->inputIntrinsic->addFnAttr(llvm::Attribute::InaccessibleMemOnly);
   }
-  return Builder.CreateCall(inputIntrinsic);
+  return ctx->Builder.CreateCall(ctx->inputIntrinsic);
 }
 
 /*
@@ -430,92 +831,293 @@ llvm::Value *InputExpr::codegen() {
  *
  * The function name values and table are setup in a shallow-pass over
  * functions performed during codegen for the Program.
+ *
+ * When the function expression is a name that is bound to a function,
+ * and not shadowed by a local, the callee is known statically.  Those
+ * calls are emitted as direct calls, which later passes can inline,
+ * tail-call or specialize, and only calls through computed function
+ * values go through the dispatch table.
  */
-llvm::Value *FunAppExpr::codegen() {
+llvm::Function *CodegenContext::getDirectCallee(Expr *FUN,
+                                                size_t numActuals) {
+  auto *var = dyn_cast<VariableExpr>(FUN);
+  if (var == nullptr || NamedValues[var->getSymbol().id] != nullptr ||
+      FunctionDecls[var->getSymbol().id].first == -1) {
+    return nullptr;
+  }
+
+  llvm::Function *callee = getFunction(var->getSymbol());
+
+  // arity mismatches are left to the generic, dispatch table, lowering
+  return (callee->arg_size() == numActuals) ? callee : nullptr;
+}
+
+llvm::Value *FunAppExpr::codegen(CodegenContext *ctx) {
+  if (auto *callee = ctx->getDirectCallee(FUN, ACTUALS.size())) {
+    std::vector<Value *> argsV;
+    for (auto const &arg : ACTUALS) {
+      Value *argVal = arg->codegen(ctx);
+      if (argVal == nullptr) {
+        return nullptr;
+      }
+      argsV.push_back(ctx->coerce(
+          argVal, callee->getFunctionType()->getParamType(argsV.size())));
+    }
+
+    int funIndex =
+        ctx->FunctionDecls[cast<VariableExpr>(FUN)->getSymbol().id].first;
+    Value *callV;
+    if (!ctx->memoized.empty() && ctx->memoized[funIndex]) {
+      callV = ctx->CreateMemoizedCall(callee, funIndex, argsV);
+    } else {
+      callV = ctx->Builder.CreateCall(callee, argsV, "calltmp");
+    }
+
+    auto *result = ctx->coerce(callV, ctx->getNodeType(getId()));
+    ctx->CreateTemporaryRoot(result);
+    return result;
+  }
+
   /*
    * Evaluate the function expression - it will resolve to an integer value
    * whether it is a function literal or an expression.
    */
-  auto *funVal = FUN->codegen();
+  auto *funVal = FUN->codegen(ctx);
   if (funVal == nullptr) {
     return nullptr;
   }
+  funVal = ctx->coerce(funVal, Type::getInt64Ty(ctx->TheContext));
 
   /*
    * Emit the GEP instruction to compute the address of LLVM function
    * pointer to be called.
    */
   std::vector<Value *> indices;
-  indices.push_back(ConstantInt::get(Type::getInt64Ty(TheContext), 0));
+  indices.push_back(ConstantInt::get(Type::getInt64Ty(ctx->TheContext), 0));
   indices.push_back(funVal);
-  auto *gep = Builder.CreateInBoundsGEP(tipFTable, indices, "ftableidx");
+  auto *gep =
+      ctx->Builder.CreateInBoundsGEP(ctx->tipFTable, indices, "ftableidx");
 
   // Load the function pointer
-  auto *genericFunPtr = Builder.CreateLoad(gep, "genfptr");
+  auto *genericFunPtr = ctx->Builder.CreateLoad(gep, "genfptr");
 
   /*
-   * Compute the specific function pointer type based on the actual parameter
-   * list.
-   *
-   * TBD: Currently the type is Int64^N -> Int64,
-   * where N is the length of the list
-   *
-   * Once type information is available we will need to iterate the actuals
-   * and construct the per actual vector of types.
+   * Compute the specific function pointer type from the type of the
+   * function expression, or Int64^N -> Int64 for N actuals when untyped.
+   * Every function that can flow to this call has the same TIP type, so
+   * they all have this signature.
    */
-  std::vector<Type *> actualTypes(ACTUALS.size(), Type::getInt64Ty(TheContext));
-  auto *funPtrType = PointerType::get(
-      FunctionType::get(Type::getInt64Ty(TheContext), actualTypes, false), 0);
+  auto *funType = ctx->getSignature(FUN->getId(), ACTUALS.size());
+  auto *funPtrType = PointerType::get(funType, 0);
 
   // Bitcast the function pointer to the call-site determined function type
   auto *castFunPtr =
-      Builder.CreatePointerCast(genericFunPtr, funPtrType, "castfptr");
+      ctx->Builder.CreatePointerCast(genericFunPtr, funPtrType, "castfptr");
 
   // Compute the actual parameters
   std::vector<Value *> argsV;
   for (auto const &arg : ACTUALS) {
-    Value *argVal = arg->codegen();
+    Value *argVal = arg->codegen(ctx);
     if (argVal == nullptr) {
       return nullptr;
     }
-    argsV.push_back(argVal);
+    argsV.push_back(ctx->coerce(argVal, funType->getParamType(argsV.size())));
   }
 
-  return Builder.CreateCall(castFunPtr, argsV, "calltmp");
+  auto *result =
+      ctx->coerce(ctx->Builder.CreateCall(castFunPtr, argsV, "calltmp"),
+                  ctx->getNodeType(getId()));
+  ctx->CreateTemporaryRoot(result);
+  return result;
 }
 
-llvm::Value *AllocExpr::codegen() {
-  Value *argVal = ARG->codegen();
-  if (argVal == nullptr) {
-    return nullptr;
+/*
+ * Call a pure function through its memo table.  The arguments, as
+ * integers, are the key, and the function is only called when the table
+ * has no result for them:
+ *
+ *   if (!_tip_memo_lookup(index, n, key, &result)) {
+ *     result = callee(args)
+ *     _tip_memo_store(index, n, key, result)
+ *   }
+ */
+Value *CodegenContext::CreateMemoizedCall(llvm::Function *callee,
+                                          int funIndex,
+                                          std::vector<Value *> &args) {
+  auto *Int64 = Type::getInt64Ty(TheContext);
+  auto *Int64Ptr = Type::getInt64PtrTy(TheContext);
+  if (memoLookupIntrinsic == nullptr) {
+    memoLookupIntrinsic = llvm::Function::Create(
+        FunctionType::get(Int64, {Int64, Int64, Int64Ptr, Int64Ptr}, false),
+        llvm::Function::ExternalLinkage, "_tip_memo_lookup",
+        CurrentModule.get());
+    memoLookupIntrinsic->addFnAttr(llvm::Attribute::NoUnwind);
+    memoLookupIntrinsic->addFnAttr(
+        llvm::Attribute::InaccessibleMemOrArgMemOnly);
+    memoStoreIntrinsic = llvm::Function::Create(
+        FunctionType::get(Type::getVoidTy(TheContext),
+                          {Int64, Int64, Int64Ptr, Int64}, false),
+        llvm::Function::ExternalLinkage, "_tip_memo_store",
+        CurrentModule.get());
+    memoStoreIntrinsic->addFnAttr(llvm::Attribute::NoUnwind);
+    memoStoreIntrinsic->addFnAttr(
+        llvm::Attribute::InaccessibleMemOrArgMemOnly);
   }
 
-  if (mallocFun == nullptr) {
+  // the key and the result only hold integers, so they are not GC roots
+  llvm::Function *TheFunction = Builder.GetInsertBlock()->getParent();
+  IRBuilder<> TmpB(&TheFunction->getEntryBlock(),
+                   TheFunction->getEntryBlock().begin());
+  auto *keyType = ArrayType::get(Int64, std::max<size_t>(args.size(), 1));
+  AllocaInst *key = TmpB.CreateAlloca(keyType, nullptr, "memokey");
+  AllocaInst *result = TmpB.CreateAlloca(Int64, nullptr, "memoresult");
+
+  for (size_t i = 0; i < args.size(); i++) {
+    Builder.CreateStore(coerce(args[i], Int64),
+                        Builder.CreateConstInBoundsGEP2_32(keyType, key, 0, i));
+  }
+  Value *keyPtr = Builder.CreateConstInBoundsGEP2_32(keyType, key, 0, 0);
+  Value *index = ConstantInt::get(Int64, funIndex);
+  Value *numArgs = ConstantInt::get(Int64, args.size());
+  Value *hit = Builder.CreateCall(memoLookupIntrinsic,
+                                  {index, numArgs, keyPtr, result}, "memohit");
+
+  labelNum++;
+  BasicBlock *CallBB = BasicBlock::Create(
+      TheContext, "memocall" + std::to_string(labelNum), TheFunction);
+  BasicBlock *DoneBB = BasicBlock::Create(
+      TheContext, "memodone" + std::to_string(labelNum), TheFunction);
+  Builder.CreateCondBr(
+      Builder.CreateICmpNE(hit, ConstantInt::get(Int64, 0), "memofound"),
+      DoneBB, CallBB);
+
+  Builder.SetInsertPoint(CallBB);
+  Value *callV = coerce(Builder.CreateCall(callee, args, "calltmp"), Int64);
+  Builder.CreateStore(callV, result);
+  Builder.CreateCall(memoStoreIntrinsic, {index, numArgs, keyPtr, callV});
+  Builder.CreateBr(DoneBB);
+
+  Builder.SetInsertPoint(DoneBB);
+  return coerce(Builder.CreateLoad(result, "memotmp"),
+                callee->getReturnType());
+}
+
+/*
+ * Allocate bytes from the heap region.  The common case is inlined as a
+ * pointer bump and a bounds check against the end of the current chunk;
+ * only when the chunk is exhausted is the "_tip_alloc" intrinsic called
+ * to map a new one.
+ */
+Value *CodegenContext::CreateHeapAlloc(uint64_t bytes) {
+  auto *size = ConstantInt::get(Type::getInt64Ty(TheContext), bytes);
+
+  // the collected heap is always allocated from out of line
+  if (gcEnabled) {
+    std::vector<Value *> oneArg(1, size);
+    return Builder.CreateCall(gcAllocIntrinsic, oneArg, "allocPtr");
+  }
+
+  if (allocIntrinsic == nullptr) {
     std::vector<Type *> oneInt(1, Type::getInt64Ty(TheContext));
     auto *FT = FunctionType::get(Type::getInt8PtrTy(TheContext), oneInt, false);
-    mallocFun = llvm::Function::Create(FT, llvm::Function::ExternalLinkage,
-                                       "malloc", CurrentModule.get());
-    mallocFun->addFnAttr(llvm::Attribute::NoUnwind);
-    mallocFun->addAttribute(0, llvm::Attribute::NoAlias);
-  }
-
-  // Since we do not support records all allocs are for 8 bytes, i.e., int64_t
-  std::vector<Value *> oneArg(
-      1, ConstantInt::get(Type::getInt64Ty(TheContext), 8));
-  auto *allocInst = Builder.CreateCall(mallocFun, oneArg, "allocPtr");
-  auto *castPtr = Builder.CreatePointerCast(
-      allocInst, Type::getInt64PtrTy(TheContext), "castPtr");
+    allocIntrinsic = llvm::Function::Create(
+        FT, llvm::Function::ExternalLinkage, "_tip_alloc", CurrentModule.get());
+    allocIntrinsic->addFnAttr(llvm::Attribute::NoUnwind);
+    allocIntrinsic->addFnAttr(llvm::Attribute::Cold);
+    allocIntrinsic->addAttribute(0, llvm::Attribute::NoAlias);
+
+    tipHeapPtr = new GlobalVariable(
+        *CurrentModule, Type::getInt8PtrTy(TheContext), false,
+        llvm::GlobalValue::ExternalLinkage, nullptr, "_tip_heap_ptr");
+    tipHeapEnd = new GlobalVariable(
+        *CurrentModule, Type::getInt8PtrTy(TheContext), false,
+        llvm::GlobalValue::ExternalLinkage, nullptr, "_tip_heap_end");
+  }
+
+  llvm::Function *TheFunction = Builder.GetInsertBlock()->getParent();
+
+  labelNum++; // create unique labels for these BBs
+  BasicBlock *BumpBB = BasicBlock::Create(
+      TheContext, "bump" + std::to_string(labelNum), TheFunction);
+  BasicBlock *RefillBB = BasicBlock::Create(
+      TheContext, "refill" + std::to_string(labelNum), TheFunction);
+  BasicBlock *AllocatedBB = BasicBlock::Create(
+      TheContext, "allocated" + std::to_string(labelNum), TheFunction);
+
+  /*
+   * The pointer is null before the first refill and the bump may step
+   * past the end of the chunk, so the bound is checked on integers and
+   * the pointer is only advanced once the allocation is known to fit.
+   */
+  auto *Int64 = Type::getInt64Ty(TheContext);
+  auto *current = Builder.CreateLoad(tipHeapPtr, "heapPtr");
+  auto *end = Builder.CreateLoad(tipHeapEnd, "heapEnd");
+  auto *nextInt = Builder.CreateAdd(Builder.CreatePtrToInt(current, Int64),
+                                    size, "heapNextInt");
+  auto *fits = Builder.CreateICmpULE(
+      nextInt, Builder.CreatePtrToInt(end, Int64), "fits");
+  Builder.CreateCondBr(fits, BumpBB, RefillBB,
+                       MDBuilder(TheContext).createBranchWeights(2000, 1));
+
+  Builder.SetInsertPoint(BumpBB);
+  auto *next = Builder.CreateInBoundsGEP(current, size, "heapNext");
+  Builder.CreateStore(next, tipHeapPtr);
+  Builder.CreateBr(AllocatedBB);
+
+  Builder.SetInsertPoint(RefillBB);
+  std::vector<Value *> oneArg(1, size);
+  auto *refilled = Builder.CreateCall(allocIntrinsic, oneArg, "refillPtr");
+  Builder.CreateBr(AllocatedBB);
+
+  Builder.SetInsertPoint(AllocatedBB);
+  PHINode *allocPtr =
+      Builder.CreatePHI(Type::getInt8PtrTy(TheContext), 2, "allocPtr");
+  allocPtr->addIncoming(current, BumpBB);
+  allocPtr->addIncoming(refilled, RefillBB);
+  return allocPtr;
+}
+
+llvm::Value *AllocExpr::codegen(CodegenContext *ctx) {
+  Value *argVal = ARG->codegen(ctx);
+  if (argVal == nullptr) {
+    return nullptr;
+  }
+
+  /*
+   * A cell that does not escape is a stack slot.  Without -gc the later
+   * passes can promote it to a register; with -gc the slot is a root,
+   * whose address is stored in the frame of the shadow stack, so it stays
+   * in memory where the collector scans it.
+   */
+  auto *cellType = ctx->getNodeType(ARG->getId());
+  bool onStack =
+      getId() < (int)ctx->stackAllocs.size() && ctx->stackAllocs[getId()];
+  Value *castPtr;
+  if (onStack) {
+    castPtr = ctx->CreateEntryBlockAlloca(
+        ctx->Builder.GetInsertBlock()->getParent(), "allocCell", cellType);
+  } else {
+    // All values, including records which are references, take 8 bytes
+    auto *allocInst = ctx->CreateHeapAlloc(8);
+    castPtr = ctx->Builder.CreatePointerCast(
+        allocInst, PointerType::get(cellType, 0), "castPtr");
+  }
   // Initialize with argument
-  auto *initializingStore = Builder.CreateStore(argVal, castPtr);
+  auto *initializingStore =
+      ctx->Builder.CreateStore(ctx->coerce(argVal, cellType), castPtr);
+  ctx->setAliasClass(initializingStore, getId());
 
-  return Builder.CreatePtrToInt(castPtr, Type::getInt64Ty(TheContext),
-                                "allocIntVal");
+  auto *allocVal = ctx->coerce(castPtr, ctx->getNodeType(getId()));
+  if (!onStack) {
+    ctx->CreateTemporaryRoot(allocVal);
+  }
+  return allocVal;
 }
 
-llvm::Value *NullExpr::codegen() {
-  auto *nullPtr = ConstantPointerNull::get(Type::getInt64PtrTy(TheContext));
-  return Builder.CreatePtrToInt(nullPtr, Type::getInt64Ty(TheContext),
-                                "nullPtrIntVal");
+llvm::Value *NullExpr::codegen(CodegenContext *ctx) {
+  auto *nullPtr =
+      ConstantPointerNull::get(Type::getInt64PtrTy(ctx->TheContext));
+  return ctx->coerce(nullPtr, ctx->getNodeType(getId()));
 }
 
 /* '&' address of expression
@@ -523,113 +1125,161 @@ llvm::Value *NullExpr::codegen() {
  * Only variables can serve as arguments to this operator.
  * Our code generation strategy has allocated all such variables
  * on the stack (via "alloca").  Consequently, in llvm this means
- * that the variable holds the address of stack location, but
- * we explicitly cast it with "ptrtoint" to enforce our invariant
+ * that the variable holds the address of stack location.  Without
+ * types we explicitly cast it with "ptrtoint" to enforce our invariant
  * that all code generation routines produce int values.
  */
-llvm::Value *RefExpr::codegen() {
-  Value *argVal = NamedValues[NAME];
+llvm::Value *RefExpr::codegen(CodegenContext *ctx) {
+  Value *argVal = ctx->NamedValues[NAME.id];
   if (argVal == nullptr) {
-    return LogError("Unknown variable name: " + NAME);
+    return LogError("Unknown variable name: " + NAME.str());
   }
 
-  return Builder.CreatePtrToInt(argVal, Type::getInt64Ty(TheContext),
-                                "intPtrVal");
+  return ctx->coerce(argVal, ctx->getNodeType(getId()));
 }
 
 /* '*' dereference expression
  *
- * The argument is assumed to be a reference expression, but
- * our code generation strategy stores everything as an integer.
- * Consequently, we convert the value with "inttoptr" before loading
- * the value at the pointed-to memory location.
+ * The argument is assumed to be a reference expression.  With types it
+ * is a pointer to the type of this expression, but without them our code
+ * generation strategy stores everything as an integer.  Consequently, we
+ * convert the value with "inttoptr" before loading the value at the
+ * pointed-to memory location.
  */
-llvm::Value *DeRefExpr::codegen() {
-  if (lValueGen) {
+llvm::Value *DeRefExpr::codegen(CodegenContext *ctx) {
+  if (ctx->lValueGen) {
     // For an l-value, just compute the address and return it.
-    lValueGen = false;
-    Value *argVal = ARG->codegen();
+    ctx->lValueGen = false;
+    Value *argVal = ARG->codegen(ctx);
     if (argVal == nullptr) {
       return nullptr;
     }
 
-    return Builder.CreateIntToPtr(argVal, Type::getInt64PtrTy(TheContext),
-                                  "ptrIntVal");
+    return ctx->coerce(argVal,
+                       PointerType::get(ctx->getNodeType(getId()), 0));
 
   } else {
     // For an r-value, compute the address and return the value it points to.
-    Value *argVal = ARG->codegen();
+    Value *argVal = ARG->codegen(ctx);
     if (argVal == nullptr) {
       return nullptr;
     }
 
-    auto *ref = Builder.CreateIntToPtr(argVal, Type::getInt64PtrTy(TheContext),
-                                       "ptrIntVal");
-    return Builder.CreateLoad(ref, "valueAt");
+    auto *ref =
+        ctx->coerce(argVal, PointerType::get(ctx->getNodeType(getId()), 0));
+    auto *load = ctx->Builder.CreateLoad(ref, "valueAt");
+    ctx->setAliasClass(load, getId());
+    return load;
   }
 }
 
-llvm::Value *RecordExpr::codegen() {
-  return LogError("Record expressions not implemented");
+/*
+ * Records are immutable, so a record value is a reference to a heap
+ * array of one Int64 slot per field of the program, with each field
+ * stored at its program-wide index.  The slots of fields that the record
+ * does not have are left zero.
+ */
+llvm::Value *RecordExpr::codegen(CodegenContext *ctx) {
+  std::vector<Value *> initVals;
+  for (auto const &field : FIELDS) {
+    Value *initVal = field->codegen(ctx);
+    if (initVal == nullptr) {
+      return nullptr;
+    }
+    initVals.push_back(initVal);
+  }
+
+  auto *allocInst = ctx->CreateHeapAlloc(8 * ctx->numRecordFields);
+  auto *recordPtr = ctx->Builder.CreatePointerCast(
+      allocInst, Type::getInt64PtrTy(ctx->TheContext), "recordPtr");
+  for (size_t i = 0; i < FIELDS.size(); i++) {
+    auto *fieldPtr = ctx->Builder.CreateConstInBoundsGEP1_32(
+        Type::getInt64Ty(ctx->TheContext), recordPtr, FIELDS[i]->getIndex(),
+        "fieldPtr");
+    auto *fieldStore = ctx->Builder.CreateStore(
+        ctx->coerce(initVals[i], Type::getInt64Ty(ctx->TheContext)), fieldPtr);
+    ctx->setAliasClass(fieldStore, getId());
+  }
+
+  auto *recordVal = ctx->coerce(recordPtr, ctx->getNodeType(getId()));
+  ctx->CreateTemporaryRoot(recordVal);
+  return recordVal;
 }
 
-llvm::Value *FieldExpr::codegen() {
-  return LogError("Field expressions not implemented");
+// The value of the field, which is stored by the enclosing record
+llvm::Value *FieldExpr::codegen(CodegenContext *ctx) {
+  return INIT->codegen(ctx);
 }
 
-llvm::Value *AccessExpr::codegen() {
-  return LogError("Field access expressions not implemented");
+// An access is a load from the constant offset of the field in the record
+llvm::Value *AccessExpr::codegen(CodegenContext *ctx) {
+  Value *recordVal = RECORD->codegen(ctx);
+  if (recordVal == nullptr) {
+    return nullptr;
+  }
+
+  auto *recordPtr =
+      ctx->coerce(recordVal, Type::getInt64PtrTy(ctx->TheContext));
+  auto *fieldPtr = ctx->Builder.CreateConstInBoundsGEP1_32(
+      Type::getInt64Ty(ctx->TheContext), recordPtr, INDEX, "fieldPtr");
+  auto *fieldVal = ctx->Builder.CreateLoad(fieldPtr, "fieldVal");
+  ctx->setAliasClass(fieldVal, getId());
+  return ctx->coerce(fieldVal, ctx->getNodeType(getId()));
 }
 
-llvm::Value *DeclStmt::codegen() {
+llvm::Value *DeclStmt::codegen(CodegenContext *ctx) {
   // The LLVM builder records the function we are currently generating
-  llvm::Function *TheFunction = Builder.GetInsertBlock()->getParent();
+  llvm::Function *TheFunction = ctx->Builder.GetInsertBlock()->getParent();
 
   AllocaInst *localAlloca = nullptr;
 
   // Register all variables and emit their initializer.
-  for (auto l : VARS) {
-    localAlloca = CreateEntryBlockAlloca(TheFunction, l);
+  for (size_t i = 0; i < VARS.size(); i++) {
+    localAlloca = ctx->CreateEntryBlockAlloca(TheFunction, VARS[i].name,
+                                              ctx->getNodeType(VAR_IDS[i]));
 
     // Initialize all locals to "0"
-    Builder.CreateStore(ConstantInt::get(Type::getInt64Ty(TheContext), 0),
-                        localAlloca);
+    ctx->Builder.CreateStore(
+        Constant::getNullValue(localAlloca->getAllocatedType()), localAlloca);
 
     // Remember this binding.
-    NamedValues[l] = localAlloca;
+    ctx->bindNamedValue(VARS[i], localAlloca);
   }
 
   // Return the body computation.
   return localAlloca;
 }
 
-llvm::Value *AssignStmt::codegen() {
+llvm::Value *AssignStmt::codegen(CodegenContext *ctx) {
   // trigger code generation for l-value expressions
-  lValueGen = true;
-  Value *lValue = LHS->codegen();
-  lValueGen = false;
+  ctx->lValueGen = true;
+  Value *lValue = LHS->codegen(ctx);
+  ctx->lValueGen = false;
 
   if (lValue == nullptr) {
     return nullptr;
   }
 
-  Value *rValue = RHS->codegen();
+  Value *rValue = RHS->codegen(ctx);
   if (rValue == nullptr) {
     return nullptr;
   }
 
-  return Builder.CreateStore(rValue, lValue);
+  auto *store = ctx->Builder.CreateStore(
+      ctx->coerce(rValue, lValue->getType()->getPointerElementType()), lValue);
+  ctx->setAliasClass(store, LHS->getId());
+  return store;
 }
 
-llvm::Value *BlockStmt::codegen() {
+llvm::Value *BlockStmt::codegen(CodegenContext *ctx) {
   Value *lastStmt = nullptr;
 
   for (auto const &s : STMTS) {
-    lastStmt = s->codegen();
+    lastStmt = s->codegen(ctx);
   }
 
   // If the block was empty return a nop
-  return (lastStmt == nullptr) ? Builder.CreateCall(nop) : lastStmt;
+  return (lastStmt == nullptr) ? ctx->Builder.CreateCall(ctx->nop) : lastStmt;
 }
 
 /*
@@ -649,8 +1299,8 @@ llvm::Value *BlockStmt::codegen() {
  * is generated into a basic block since it will be branched to after the
  * body executes.
  */
-llvm::Value *WhileStmt::codegen() {
-  llvm::Function *TheFunction = Builder.GetInsertBlock()->getParent();
+llvm::Value *WhileStmt::codegen(CodegenContext *ctx) {
+  llvm::Function *TheFunction = ctx->Builder.GetInsertBlock()->getParent();
 
   /*
    * Create blocks for the loop header, body, and exit; HeaderBB is first
@@ -660,51 +1310,58 @@ llvm::Value *WhileStmt::codegen() {
    * any particular way because we will explicitly branch between them.
    * This can be optimized by later passes.
    */
-  labelNum++; // create unique labels for these BBs
+  ctx->labelNum++; // create unique labels for these BBs
 
   BasicBlock *HeaderBB = BasicBlock::Create(
-      TheContext, "header" + std::to_string(labelNum), TheFunction);
-  BasicBlock *BodyBB =
-      BasicBlock::Create(TheContext, "body" + std::to_string(labelNum));
-  BasicBlock *ExitBB =
-      BasicBlock::Create(TheContext, "exit" + std::to_string(labelNum));
+      ctx->TheContext, "header" + std::to_string(ctx->labelNum), TheFunction);
+  BasicBlock *BodyBB = BasicBlock::Create(
+      ctx->TheContext, "body" + std::to_string(ctx->labelNum));
+  BasicBlock *ExitBB = BasicBlock::Create(
+      ctx->TheContext, "exit" + std::to_string(ctx->labelNum));
+
+  // count the edges into the body and the exit
+  unsigned counter = ctx->CreateProfileCounters(2);
 
   // Add an explicit branch from the current BB to the header
-  Builder.CreateBr(HeaderBB);
+  ctx->Builder.CreateBr(HeaderBB);
 
   // Emit loop header
   {
-    Builder.SetInsertPoint(HeaderBB);
+    ctx->Builder.SetInsertPoint(HeaderBB);
 
-    Value *CondV = COND->codegen();
+    Value *CondV = COND->codegen(ctx);
     if (CondV == nullptr) {
       return nullptr;
     }
 
     // Convert condition to a bool by comparing non-equal to 0.
-    CondV = Builder.CreateICmpNE(CondV, ConstantInt::get(CondV->getType(), 0),
-                                 "loopcond");
+    CondV = ctx->coerce(CondV, Type::getInt64Ty(ctx->TheContext));
+    CondV = ctx->Builder.CreateICmpNE(
+        CondV, ConstantInt::get(CondV->getType(), 0), "loopcond");
 
-    Builder.CreateCondBr(CondV, BodyBB, ExitBB);
+    auto *BI = ctx->Builder.CreateCondBr(CondV, BodyBB, ExitBB);
+    ctx->setBranchWeights(BI, counter);
   }
 
   // Emit loop body
   {
     TheFunction->getBasicBlockList().push_back(BodyBB);
-    Builder.SetInsertPoint(BodyBB);
+    ctx->Builder.SetInsertPoint(BodyBB);
+    ctx->CreateProfileIncrement(counter);
 
-    Value *BodyV = BODY->codegen();
+    Value *BodyV = BODY->codegen(ctx);
     if (BodyV == nullptr) {
       return nullptr;
     }
 
-    Builder.CreateBr(HeaderBB);
+    ctx->Builder.CreateBr(HeaderBB);
   }
 
   // Emit loop exit block.
   TheFunction->getBasicBlockList().push_back(ExitBB);
-  Builder.SetInsertPoint(ExitBB);
-  return Builder.CreateCall(nop);
+  ctx->Builder.SetInsertPoint(ExitBB);
+  ctx->CreateProfileIncrement(counter + 1);
+  return ctx->Builder.CreateCall(ctx->nop);
 }
 
 /*
@@ -722,17 +1379,18 @@ llvm::Value *WhileStmt::codegen() {
  * the insertion point, and then letting other codegen functions write
  * code at that insertion point.
  */
-llvm::Value *IfStmt::codegen() {
-  Value *CondV = COND->codegen();
+llvm::Value *IfStmt::codegen(CodegenContext *ctx) {
+  Value *CondV = COND->codegen(ctx);
   if (CondV == nullptr) {
     return nullptr;
   }
 
   // Convert condition to a bool by comparing non-equal to 0.
-  CondV = Builder.CreateICmpNE(CondV, ConstantInt::get(CondV->getType(), 0),
-                               "ifcond");
+  CondV = ctx->coerce(CondV, Type::getInt64Ty(ctx->TheContext));
+  CondV = ctx->Builder.CreateICmpNE(
+      CondV, ConstantInt::get(CondV->getType(), 0), "ifcond");
 
-  llvm::Function *TheFunction = Builder.GetInsertBlock()->getParent();
+  llvm::Function *TheFunction = ctx->Builder.GetInsertBlock()->getParent();
 
   /*
    * Create blocks for the then and else cases.  The then block is first so
@@ -742,93 +1400,114 @@ llvm::Value *IfStmt::codegen() {
    * any particular way because we will explicitly branch between them.
    * This can be optimized to fall through behavior by later passes.
    */
-  labelNum++; // create unique labels for these BBs
+  ctx->labelNum++; // create unique labels for these BBs
   BasicBlock *ThenBB = BasicBlock::Create(
-      TheContext, "then" + std::to_string(labelNum), TheFunction);
-  BasicBlock *ElseBB =
-      BasicBlock::Create(TheContext, "else" + std::to_string(labelNum));
-  BasicBlock *MergeBB =
-      BasicBlock::Create(TheContext, "ifmerge" + std::to_string(labelNum));
+      ctx->TheContext, "then" + std::to_string(ctx->labelNum), TheFunction);
+  BasicBlock *ElseBB = BasicBlock::Create(
+      ctx->TheContext, "else" + std::to_string(ctx->labelNum));
+  BasicBlock *MergeBB = BasicBlock::Create(
+      ctx->TheContext, "ifmerge" + std::to_string(ctx->labelNum));
 
-  Builder.CreateCondBr(CondV, ThenBB, ElseBB);
+  // count the edges into the then and the else block
+  unsigned counter = ctx->CreateProfileCounters(2);
+  auto *BI = ctx->Builder.CreateCondBr(CondV, ThenBB, ElseBB);
+  ctx->setBranchWeights(BI, counter);
 
   // Emit then block.
   {
-    Builder.SetInsertPoint(ThenBB);
+    ctx->Builder.SetInsertPoint(ThenBB);
+    ctx->CreateProfileIncrement(counter);
 
-    Value *ThenV = THEN->codegen();
+    Value *ThenV = THEN->codegen(ctx);
     if (ThenV == nullptr) {
       return nullptr;
     }
 
-    Builder.CreateBr(MergeBB);
+    ctx->Builder.CreateBr(MergeBB);
   }
 
   // Emit else block.
   {
     TheFunction->getBasicBlockList().push_back(ElseBB);
-    Builder.SetInsertPoint(ElseBB);
+    ctx->Builder.SetInsertPoint(ElseBB);
+    ctx->CreateProfileIncrement(counter + 1);
 
     // if there is no ELSE then exist emit a "nop"
     Value *ElseV = nullptr;
     if (ELSE != nullptr) {
-      ElseV = ELSE->codegen();
+      ElseV = ELSE->codegen(ctx);
       if (ElseV == nullptr) {
         return nullptr;
       }
     } else {
-      Builder.CreateCall(nop);
+      ctx->Builder.CreateCall(ctx->nop);
     }
 
-    Builder.CreateBr(MergeBB);
+    ctx->Builder.CreateBr(MergeBB);
   }
 
   // Emit merge block.
   TheFunction->getBasicBlockList().push_back(MergeBB);
-  Builder.SetInsertPoint(MergeBB);
-  return Builder.CreateCall(nop);
+  ctx->Builder.SetInsertPoint(MergeBB);
+  return ctx->Builder.CreateCall(ctx->nop);
 }
 
-llvm::Value *OutputStmt::codegen() {
-  if (outputIntrinsic == nullptr) {
-    std::vector<Type *> oneInt(1, Type::getInt64Ty(TheContext));
-    auto *FT = FunctionType::get(Type::getInt64Ty(TheContext), oneInt, false);
-    outputIntrinsic =
+llvm::Value *OutputStmt::codegen(CodegenContext *ctx) {
+  if (ctx->outputIntrinsic == nullptr) {
+    std::vector<Type *> oneInt(1, Type::getInt64Ty(ctx->TheContext));
+    auto *FT =
+        FunctionType::get(Type::getVoidTy(ctx->TheContext), oneInt, false);
+    ctx->outputIntrinsic =
         llvm::Function::Create(FT, llvm::Function::ExternalLinkage,
-                               "_tip_output", CurrentModule.get());
+                               "_tip_output", ctx->CurrentModule.get());
+    ctx->outputIntrinsic->addFnAttr(llvm::Attribute::NoUnwind);
+    ctx->outputIntrinsic->addFnAttr(llvm::Attribute::InaccessibleMemOnly);
   }
 
-  Value *argVal = ARG->codegen();
+  Value *argVal = ARG->codegen(ctx);
   if (argVal == nullptr) {
     return nullptr;
   }
 
-  std::vector<Value *> ArgsV(1, argVal);
+  std::vector<Value *> ArgsV(
+      1, ctx->coerce(argVal, Type::getInt64Ty(ctx->TheContext)));
 
-  return Builder.CreateCall(outputIntrinsic, ArgsV);
+  return ctx->Builder.CreateCall(ctx->outputIntrinsic, ArgsV);
 }
 
-llvm::Value *ErrorStmt::codegen() {
-  if (errorIntrinsic == nullptr) {
-    std::vector<Type *> oneInt(1, Type::getInt64Ty(TheContext));
-    auto *FT = FunctionType::get(Type::getInt64Ty(TheContext), oneInt, false);
-    errorIntrinsic = llvm::Function::Create(FT, llvm::Function::ExternalLinkage,
-                                            "_tip_error", CurrentModule.get());
+llvm::Value *ErrorStmt::codegen(CodegenContext *ctx) {
+  if (ctx->errorIntrinsic == nullptr) {
+    std::vector<Type *> oneInt(1, Type::getInt64Ty(ctx->TheContext));
+    auto *FT =
+        FunctionType::get(Type::getVoidTy(ctx->TheContext), oneInt, false);
+    ctx->errorIntrinsic =
+        llvm::Function::Create(FT, llvm::Function::ExternalLinkage,
+                               "_tip_error", ctx->CurrentModule.get());
+    ctx->errorIntrinsic->addFnAttr(llvm::Attribute::NoUnwind);
+    ctx->errorIntrinsic->addFnAttr(llvm::Attribute::NoReturn);
+    ctx->errorIntrinsic->addFnAttr(llvm::Attribute::Cold);
   }
 
-  Value *argVal = ARG->codegen();
+  Value *argVal = ARG->codegen(ctx);
   if (argVal == nullptr) {
     return nullptr;
   }
 
-  std::vector<Value *> ArgsV(1, argVal);
+  std::vector<Value *> ArgsV(
+      1, ctx->coerce(argVal, Type::getInt64Ty(ctx->TheContext)));
 
-  return Builder.CreateCall(errorIntrinsic, ArgsV);
+  return ctx->Builder.CreateCall(ctx->errorIntrinsic, ArgsV);
 }
 
-llvm::Value *ReturnStmt::codegen() {
-  Value *argVal = ARG->codegen();
-  return Builder.CreateRet(argVal);
+llvm::Value *ReturnStmt::codegen(CodegenContext *ctx) {
+  Value *argVal = ARG->codegen(ctx);
+  if (argVal == nullptr) {
+    return nullptr;
+  }
+
+  llvm::Function *TheFunction = ctx->Builder.GetInsertBlock()->getParent();
+  return ctx->Builder.CreateRet(
+      ctx->coerce(argVal, TheFunction->getReturnType()));
 }
 
 } // namespace TIPtree
@@ -10,6 +10,7 @@
 #include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/Support/FileSystem.h"
@@ -21,4 +22,200 @@
 #include "llvm/Transforms/Scalar/GVN.h"
 #include "llvm/Transforms/Utils.h"
 
+#include "TIPprofile.h"
 #include "TIPtree.h"
+
+class TIPtype;
+
+namespace TIPtree {
+
+/*
+ * CodegenContext - the state of generating code for one Program
+ *
+ * This records lots of information that spans the codegen() routines,
+ * for example the builder with its current insertion point, the function
+ * and variable symbol tables and the declarations of the intrinsics used
+ * by the module.  A context is created for each call to Program::codegen
+ * and passed to every codegen() routine, so separate programs can be
+ * compiled concurrently as long as each uses its own LLVMContext.
+ */
+class CodegenContext {
+public:
+  CodegenContext(llvm::LLVMContext &TheContext, const CodegenOptions &options)
+      : TheContext(TheContext), Builder(TheContext),
+        typeSolver(options.solver), gcEnabled(options.useGC),
+        instrument(options.instrument), profile(options.profile) {}
+
+  llvm::LLVMContext &TheContext;
+  llvm::IRBuilder<> Builder;
+
+  /*
+   * This function symbol table stores, for each function, its index
+   * and the names of its formal parameters.  It is indexed by the symbol
+   * id of the function name and the index is -1 for symbols that do not
+   * name a function.  The LLVM signatures of the functions are recorded
+   * by function index.
+   */
+  std::vector<std::pair<int, std::vector<Symbol>>> FunctionDecls;
+  std::vector<llvm::FunctionType *> FunctionSigs;
+
+  /*
+   * When type inference has succeeded the solver gives the type of every
+   * node, and values are lowered to the LLVM types of their TIP types, so
+   * that references are pointers rather than integers.  Without types
+   * every value is an Int64.  In both cases each use site coerces the
+   * values it consumes to the type it needs, which is a no-op when the
+   * types agree.
+   */
+  UnionFindSolver *typeSolver;
+
+  /*
+   * This structure stores the mapping from names in a function scope
+   * to their LLVM values, indexed by symbol id.  The structure is built
+   * when entering a scope and cleared when exiting a scope; NamedSymbols
+   * records which entries were set so clearing is proportional to the
+   * scope.
+   */
+  std::vector<llvm::AllocaInst *> NamedValues;
+  std::vector<int> NamedSymbols;
+
+  // Symbol id of "main", which is compiled specially, or -1 if not present
+  int mainSymbol = -1;
+
+  // Permits getFunction to access the current module being compiled
+  std::unique_ptr<llvm::Module> CurrentModule;
+
+  /*
+   * We use calls to intrinsic for several purposes.  To construct a "nop",
+   * using an LLVM internal intrinsic, to perform TIP specific IO, and
+   * to allocate heap memory.
+   */
+  llvm::Function *nop = nullptr;
+  llvm::Function *inputIntrinsic = nullptr;
+  llvm::Function *outputIntrinsic = nullptr;
+  llvm::Function *errorIntrinsic = nullptr;
+  llvm::Function *allocIntrinsic = nullptr;
+
+  /*
+   * The heap is a bump-pointer region managed by the intrinsics, these are
+   * the current allocation pointer and the end of the current chunk.
+   */
+  llvm::GlobalVariable *tipHeapPtr = nullptr;
+  llvm::GlobalVariable *tipHeapEnd = nullptr;
+
+  /*
+   * When compiling for the garbage collector, allocation goes through the
+   * "_tip_gc_alloc" intrinsic and each function pushes a frame that lists
+   * its stack slots, the GC roots, onto the "_tip_gc_frames" shadow stack.
+   */
+  bool gcEnabled;
+  llvm::Function *gcAllocIntrinsic = nullptr;
+  llvm::GlobalVariable *tipGCFrames = nullptr;
+  std::vector<llvm::AllocaInst *> gcRoots;
+
+  /*
+   * When instrumenting, each function calls "_tip_instr_enter" with its
+   * index on entry and "_tip_instr_exit" before each return, so the
+   * intrinsics can count its calls and the cycles spent in it.
+   */
+  bool instrument;
+  llvm::Function *instrEnterIntrinsic = nullptr;
+  llvm::Function *instrExitIntrinsic = nullptr;
+
+  /*
+   * When memoizing, the direct calls of the pure functions, by function
+   * index, look up and record their results in the memo tables of the
+   * intrinsics.
+   */
+  std::vector<bool> memoized;
+  llvm::Function *memoLookupIntrinsic = nullptr;
+  llvm::Function *memoStoreIntrinsic = nullptr;
+
+  /*
+   * With the alias classes of the points-to analysis, by node id, each
+   * load and store of a location in a class is in the alias scope of the
+   * class and does not alias the scopes of the other classes accessed by
+   * the same function.  The accesses of the function being generated are
+   * annotated once it is complete, when its classes are known.
+   */
+  std::vector<int> aliasClasses;
+  llvm::MDNode *aliasDomain = nullptr;
+  std::vector<llvm::MDNode *> aliasScopes;
+  std::vector<std::pair<llvm::Instruction *, int>> aliasAccesses;
+
+  /*
+   * The allocations, by node id, whose cells do not escape the call that
+   * allocates them, which are allocated on the stack.
+   */
+  std::vector<bool> stackAllocs;
+
+  // Records have a slot for each of this many fields of the program
+  int numRecordFields = 0;
+
+  // A counter to create unique labels
+  int labelNum = 0;
+
+  // Indicate whether the expression code gen is for an L-value
+  bool lValueGen = false;
+
+  /*
+   * The global function dispatch table is created in a shallow pass over
+   * the function signatures, stored here, and then referenced in
+   * generating function applications.
+   */
+  llvm::GlobalVariable *tipFTable = nullptr;
+
+  // The number of TIP program parameters
+  int numTIPArgs = 0;
+
+  /*
+   * The global argument count and array are used to communicate command
+   * line inputs to the TIP main function.
+   */
+  llvm::GlobalVariable *tipNumInputs = nullptr;
+  llvm::GlobalVariable *tipInputArray = nullptr;
+
+  /*
+   * With -fprofile-generate the entry of each function and each edge out
+   * of an if or a while increments a counter of "_tip_prof_counters",
+   * which the intrinsics write out when the program exits.  With
+   * -fprofile-use the counts of the same counters become the entry counts
+   * and branch weights of the module.  Counters are numbered in the order
+   * they are created, and the counters are a placeholder until the end of
+   * codegen, when their number is known.
+   */
+  const TIPprofile *profile;
+  unsigned numCounters = 0;
+  llvm::GlobalVariable *tipProfCounters = nullptr;
+  // the entry and edge counts of each function, for the profile summary
+  std::vector<std::vector<uint64_t>> profileRecords;
+
+  // Routines shared by the codegen() routines
+  llvm::Type *lowerType(TIPtype *type);
+  llvm::Type *getNodeType(int id);
+  llvm::FunctionType *getSignature(int id, size_t arity);
+  llvm::Value *coerce(llvm::Value *V, llvm::Type *T);
+  void bindNamedValue(Symbol name, llvm::AllocaInst *alloca);
+  void clearNamedValues();
+  llvm::Function *getFunction(Symbol Name);
+  llvm::Function *getDirectCallee(Expr *FUN, size_t numActuals);
+  llvm::AllocaInst *CreateEntryBlockAlloca(llvm::Function *TheFunction,
+                                           llvm::StringRef VarName,
+                                           llvm::Type *T);
+  void CreateTemporaryRoot(llvm::Value *V);
+  void CreateGCFrame(llvm::Function *TheFunction);
+  void CreateInstrumentation(llvm::Function *TheFunction, int funIndex);
+  llvm::Value *CreateHeapAlloc(uint64_t bytes);
+  llvm::Value *CreateMemoizedCall(llvm::Function *callee, int funIndex,
+                                 std::vector<llvm::Value *> &args);
+  unsigned CreateProfileCounters(unsigned n);
+  uint64_t getProfileCount(unsigned counter);
+  void CreateProfileIncrement(unsigned counter);
+  void setBranchWeights(llvm::BranchInst *BI, unsigned counter);
+  void setFunctionProfile(llvm::Function *TheFunction, unsigned counter);
+  void finishProfile();
+  void setAliasClass(llvm::Instruction *I, int id);
+  void setAliasScopes();
+};
+
+} // namespace TIPtree
@@ -2,9 +2,9 @@
 
 namespace TIPtree {
 
-static std::string indent;
-static int indentLevel = 0;
-static bool printLines = false;
+static thread_local std::string indent;
+static thread_local int indentLevel = 0;
+static thread_local bool printLines = false;
 
 // indentation is the contatenation of "level" indent strings
 std::string indentation() {
@@ -26,16 +26,16 @@ std::string Program::print(std::string i, bool pl = false) {
 }
 
 std::string Function::print() {
-  std::string pp = NAME + "(";
+  std::string pp = NAME.str() + "(";
 
   // comma separated parameter name list
   bool skip = true;
   for (auto param : FORMALS) {
     if (skip) {
       skip = false;
-      pp += param;
+      pp += param.str();
     } else {
-      pp += ", " + param;
+      pp += ", " + param.str();
     }
   }
   pp += ")";
@@ -65,10 +65,31 @@ std::string Function::print() {
 
 std::string NumberExpr::print() { return std::to_string(VAL); }
 
-std::string VariableExpr::print() { return NAME; }
+std::string VariableExpr::print() { return NAME.str(); }
 
 std::string BinaryExpr::print() {
-  return "(" + LHS->print() + " " + OP + " " + RHS->print() + ")";
+  const char *op = "";
+  switch (OP) {
+  case OpMul:
+    op = "*";
+    break;
+  case OpDiv:
+    op = "/";
+    break;
+  case OpAdd:
+    op = "+";
+    break;
+  case OpSub:
+    op = "-";
+    break;
+  case OpGt:
+    op = ">";
+    break;
+  case OpEq:
+    op = "==";
+    break;
+  }
+  return "(" + LHS->print() + " " + op + " " + RHS->print() + ")";
 }
 
 std::string InputExpr::print() { return "input"; }
@@ -91,13 +112,13 @@ std::string FunAppExpr::print() {
 
 std::string AllocExpr::print() { return "alloc " + ARG->print(); }
 
-std::string RefExpr::print() { return "&" + NAME; }
+std::string RefExpr::print() { return "&" + NAME.str(); }
 
 std::string DeRefExpr::print() { return "*" + ARG->print(); }
 
 std::string NullExpr::print() { return "null"; }
 
-std::string FieldExpr::print() { return FIELD + ":" + INIT->print(); }
+std::string FieldExpr::print() { return FIELD.str() + ":" + INIT->print(); }
 
 std::string RecordExpr::print() {
   std::string pp = "{";
@@ -115,7 +136,7 @@ std::string RecordExpr::print() {
   return pp;
 }
 
-std::string AccessExpr::print() { return RECORD->print() + "." + FIELD; }
+std::string AccessExpr::print() { return RECORD->print() + "." + FIELD.str(); }
 
 std::string DeclStmt::print() {
   std::string pp = "var ";
@@ -124,9 +145,9 @@ std::string DeclStmt::print() {
   for (auto id : VARS) {
     if (skip) {
       skip = false;
-      pp += id;
+      pp += id.str();
     } else {
-      pp += ", " + id;
+      pp += ", " + id.str();
     }
   }
   pp += ";";
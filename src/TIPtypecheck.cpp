@@ -1,59 +1,89 @@
 #include "TIPtree.h"
 #include "UnionFindSolver.h"
 #include "TIPtypes.h"
-#include <iostream>
 
 namespace TIPtree {
 
+/*
+ * Typechecking a node adds the constraints on the types of it and its
+ * children to the solver, which are solved once the whole program has
+ * been visited.  The type of a node is the variable with the node's id.
+ */
+static TIPtype* typeOf(AstNode* node, UnionFindSolver* solver)
+{
+    return solver->getVar(node->getId());
+}
+
+/*
+ * Type check a child node and locate the errors raised by it at the node.
+ * Errors raised by a descendant are already located at the descendant.
+ */
+static void typecheckAt(AstNode *node, UnionFindSolver* solver)
+{
+    try {
+        node->typecheck(solver);
+    } catch (TIPTypeError &e) {
+        e.locate(node->getId(), node->line, node->column);
+        throw;
+    }
+}
+
 void NumberExpr::typecheck(UnionFindSolver* solver)
 {
-    solver->setType(getId(), new TIPint());
+    solver->addConstraint(typeOf(this, solver), solver->types.getInt(), this);
 }
 
 void VariableExpr::typecheck(UnionFindSolver* solver)
 {
     if (!solver->existNode(getId())) {
-        throw TIPTypeError("Variable " + print() + " not declared");
+        throw TIPTypeError([this]() {
+            return "Variable " + print() + " not declared";
+        });
     }
+    solver->addReference(getId());
 }
 
 void BinaryExpr::typecheck(UnionFindSolver* solver)
 {
-    LHS->typecheck(solver);
-    RHS->typecheck(solver);
-    if (OP == "=") {
-        solver->unifyNodes(LHS->getId(), RHS->getId());
-    } else {
-        solver->setType(LHS->getId(), new TIPint());
-        solver->setType(RHS->getId(), new TIPint());
+    typecheckAt(LHS, solver);
+    typecheckAt(RHS, solver);
+    TIPtype* int_type = solver->types.getInt();
+    switch (OP) {
+    case OpEq:
+        //equality compares values of any type, but both sides must agree
+        solver->addConstraint(typeOf(LHS, solver), typeOf(RHS, solver), this);
+        break;
+    default:
+        solver->addConstraint(typeOf(LHS, solver), int_type, this);
+        solver->addConstraint(typeOf(RHS, solver), int_type, this);
+        break;
     }
-    solver->setType(getId(), new TIPint());
+    solver->addConstraint(typeOf(this, solver), int_type, this);
 }
 
 void InputExpr::typecheck(UnionFindSolver* solver)
 {
-    solver->setType(getId(), new TIPint());
+    solver->addConstraint(typeOf(this, solver), solver->types.getInt(), this);
 }
 
 void AllocExpr::typecheck(UnionFindSolver* solver)
 {
-    ARG->typecheck(solver);
-    solver->setType(getId(), new TIPref(solver->getType(ARG->getId())));
+    typecheckAt(ARG, solver);
+    solver->addConstraint(typeOf(this, solver),
+                          solver->types.getRef(typeOf(ARG, solver)), this);
 }
 
 void RefExpr::typecheck(UnionFindSolver* solver)
 {
-    solver->setType(getId(), new TIPref(solver->getType(refId)));
+    solver->addConstraint(typeOf(this, solver),
+                          solver->types.getRef(solver->getVar(refId)), this);
 }
 
 void DeRefExpr::typecheck(UnionFindSolver* solver)
 {
-    ARG->typecheck(solver);
-    TIPref* ref = dynamic_cast<TIPref*>(solver->getType(ARG->getId()));
-    if (ref == nullptr) {
-        throw TIPTypeError(ARG->print()+" cannot be dereferenced");
-    }
-    solver->setType(getId(), ref->of);
+    typecheckAt(ARG, solver);
+    solver->addConstraint(typeOf(ARG, solver),
+                          solver->types.getRef(typeOf(this, solver)), this);
 }
 
 void DeclStmt::typecheck(UnionFindSolver* solver)
@@ -66,137 +96,97 @@ void DeclStmt::typecheck(UnionFindSolver* solver)
 void BlockStmt::typecheck(UnionFindSolver* solver)
 {
     for (auto const &stmt : STMTS) {
-        stmt->typecheck(solver);
+        typecheckAt(stmt, solver);
     }
 }
 
 void AssignStmt::typecheck(UnionFindSolver* solver)
 {
-    LHS->typecheck(solver);
-    RHS->typecheck(solver);
-    std::string left = LHS->print();
-    std::string right = RHS->print();
-    std::string left_type = solver->getType(LHS->getId())->print();
-    std::string right_type = solver->getType(RHS->getId())->print();
-    solver->unifyNodes(LHS->getId(), RHS->getId());
+    typecheckAt(LHS, solver);
+    typecheckAt(RHS, solver);
+    solver->addConstraint(typeOf(LHS, solver), typeOf(RHS, solver), this);
 }
 
 void WhileStmt::typecheck(UnionFindSolver* solver)
 {
-    COND->typecheck(solver);
-    solver->setType(COND->getId(), new TIPint());
-    BODY->typecheck(solver);
+    typecheckAt(COND, solver);
+    solver->addConstraint(typeOf(COND, solver), solver->types.getInt(), this);
+    typecheckAt(BODY, solver);
 }
 
 void IfStmt::typecheck(UnionFindSolver* solver)
 {
-    COND->typecheck(solver);
-    solver->setType(COND->getId(), new TIPint());
-    THEN->typecheck(solver);
+    typecheckAt(COND, solver);
+    solver->addConstraint(typeOf(COND, solver), solver->types.getInt(), this);
+    typecheckAt(THEN, solver);
     //else could be null
     if (ELSE != nullptr) {
-        ELSE->typecheck(solver);
+        typecheckAt(ELSE, solver);
     }
 }
 
 void OutputStmt::typecheck(UnionFindSolver* solver)
 {
-    ARG->typecheck(solver);
-    solver->setType(ARG->getId(), new TIPint());
+    typecheckAt(ARG, solver);
+    solver->addConstraint(typeOf(ARG, solver), solver->types.getInt(), this);
 }
 
 void ReturnStmt::typecheck(UnionFindSolver* solver)
 {
-    ARG->typecheck(solver);
+    typecheckAt(ARG, solver);
 }
 
 void FunAppExpr::typecheck(UnionFindSolver* solver)
 {
-    TIPfun* funType = dynamic_cast<TIPfun*>(solver->getType(FUN->getId()));
-    if (funType == nullptr) {
-        solver->addNode(FUN->getId());
-        std::vector<TIPtype*> param_types;
-        for (auto const& param : ACTUALS) {
-            param_types.push_back(solver->getType(param->getId()));
-        }
-        solver->setType(FUN->getId(), new TIPfun(param_types, new TIPalpha()));
-        return;
-    }
-    std::vector<TIPtype*> param_types = funType->param_types;
-    if (param_types.size() != ACTUALS.size()) {
-        throw TIPTypeError("calling function "+FUN->print()+" with invalid number of parameters");
-    }
-    for (int i = 0; i < param_types.size(); i++) {
-        solver->setType(ACTUALS[i]->getId(), param_types[i]);
-    }
-    solver->setType(getId(), funType->ret);
-    //unify funappexpr type information with fun definition
-    std::vector<TIPtype*> updated_param_types;
+    typecheckAt(FUN, solver);
+    std::vector<TIPtype*> param_types;
     for (auto const& actual : ACTUALS) {
-        updated_param_types.push_back(solver->getType(actual->getId()));
+        typecheckAt(actual, solver);
+        param_types.push_back(typeOf(actual, solver));
     }
-    TIPtype* updated_ret_type = solver->getType(getId());
-    solver->setType(FUN->getId(), new TIPfun(updated_param_types, updated_ret_type));
+    //the function is called with the actuals and returns the call's type
+    solver->addConstraint(
+        typeOf(FUN, solver),
+        solver->types.getFun(param_types, typeOf(this, solver)), this);
 }
 
-
-
 void Function::typecheck(UnionFindSolver* solver)
 {
+    solver->beginFunction(getId());
     for (int param_id : FORMAL_IDS) {
         solver->addNode(param_id);
     }
     for (auto const &decl : DECLS) {
-        try
-        {
-            decl->typecheck(solver);
-        }
-        catch(const std::exception& e)
-        {
-            std::cerr << "Exception at: " << decl->print() << e.what() << '\n';
-            throw e;
-        }
+        typecheckAt(decl, solver);
     }
     for (auto const &stmt : BODY) {
-        try
-        {
-            stmt->typecheck(solver);
-        }
-        catch(const std::exception& e)
-        {
-            std::cerr << "Exception at: " << stmt->print() << e.what() << '\n';
-            throw e;
-        }
+        typecheckAt(stmt, solver);
     }
     TIPtype* ret_type = nullptr;
     for (auto const &stmt : BODY) {
-        if (stmt->print().substr(0,6) == "return") {
-            ret_type = solver->getType(dynamic_cast<ReturnStmt*>(stmt.get())->getArgId());
+        if (auto *ret = llvm::dyn_cast<ReturnStmt>(stmt)) {
+            ret_type = solver->getVar(ret->getArgId());
             break;
         }
     }
     if (ret_type == nullptr) {
-        throw TIPTypeError("No return statement found for function " + NAME);
+        throw TIPTypeError([this]() {
+            return "No return statement found for function " + NAME.str();
+        });
     }
     std::vector<TIPtype*> param_types;
     for (int param : FORMAL_IDS) {
-        param_types.push_back(solver->getType(param));
+        param_types.push_back(solver->getVar(param));
     }
-    solver->addNode(getId());
-    solver->setType(getId(), new TIPfun(param_types, ret_type));
-    //unify params with function type info
-    TIPfun* fun_type = dynamic_cast<TIPfun*>(solver->getType(getId()));
-    for (int i=0;i<FORMAL_IDS.size();i++) {
-        solver->setType(FORMAL_IDS[i], fun_type->param_types[i]);
-    }
-
+    solver->addConstraint(typeOf(this, solver),
+                          solver->types.getFun(param_types, ret_type), this);
 }
 
 std::string Function::printTyped(UnionFindSolver* solver) {
     //print function signature
-    std::string typedFun = NAME + "(";
+    std::string typedFun = NAME.str() + "(";
     for (auto it = FORMALS.begin(); it != FORMALS.end(); ++it) {
-        typedFun += *it;
+        typedFun += it->str();
         if (std::next(it) != FORMALS.end()) {
             typedFun += ",";
         }
@@ -214,14 +204,7 @@ std::string Function::printTyped(UnionFindSolver* solver) {
     return typedFun;
 }
 
-std::string Program::printTyped() {
-    UnionFindSolver* solver = new UnionFindSolver();
-    //typecheck functions twice to check function use before function definition
-    for (int i=0;i<3;i++) {
-        for (auto const &fun : FUNCTIONS) {
-            fun->typecheck(solver);
-        }
-    }
+std::string Program::printTyped(UnionFindSolver* solver) {
     std::string typedProgram;
     for (auto const &fun : FUNCTIONS) {
         typedProgram += fun->printTyped(solver) + "\n";
@@ -230,14 +213,27 @@ std::string Program::printTyped() {
 }
 
 void Program::typecheck(UnionFindSolver* solver) {
-    return;
+    std::vector<std::string> field_names;
+    for (auto const &field : FIELDS) {
+        field_names.push_back(field.str());
+    }
+    solver->types.setFieldNames(field_names);
+    solver->setNumNodes(NUM_IDS);
+    //functions are declared first, so they can be used before they are defined
+    for (auto const &fun : FUNCTIONS) {
+        solver->addFunction(fun->getId());
+    }
+    for (auto const &fun : FUNCTIONS) {
+        typecheckAt(fun, solver);
+    }
+    solver->solve();
 }
 
 std::string DeclStmt::printTyped(UnionFindSolver* solver) {
     std::string declTyped = "var ";
     // comma separated variable names list
     for (int i=0; i<VARS.size(); i++) {
-        declTyped += VARS[i] + ": ";
+        declTyped += VARS[i].str() + ": ";
         declTyped += solver->getType(VAR_IDS[i])->print();
         if (i != VARS.size()-1) {
             declTyped += ",";
@@ -247,26 +243,45 @@ std::string DeclStmt::printTyped(UnionFindSolver* solver) {
     return declTyped;
 }
 
-/**
- * Empty typechecks: record is not implemented, nullexpr and errorstmt 
- * do not need typechecking  
- */
-void NullExpr::typecheck(UnionFindSolver* solver)
-{
-    return;
-}
-
 void FieldExpr::typecheck(UnionFindSolver* solver)
 {
-    return;
+    typecheckAt(INIT, solver);
+    solver->addConstraint(typeOf(this, solver), typeOf(INIT, solver), this);
 }
 
 void RecordExpr::typecheck(UnionFindSolver* solver)
 {
-    return;
+    //a record has exactly the fields it is built with, all others are absent
+    std::vector<TIPtype*> field_types(solver->types.numFields(), solver->types.getAbsent());
+    for (auto const &field : FIELDS) {
+        typecheckAt(field, solver);
+        field_types[field->getIndex()] = typeOf(field, solver);
+    }
+    solver->addConstraint(typeOf(this, solver),
+                          solver->types.getRecord(field_types), this);
 }
 
 void AccessExpr::typecheck(UnionFindSolver* solver)
+{
+    typecheckAt(RECORD, solver);
+    //the record may have any other fields
+    std::vector<TIPtype*> field_types;
+    for (int i = 0; i < solver->types.numFields(); i++) {
+        field_types.push_back(i == INDEX ? typeOf(this, solver)
+                                         : solver->freshVar());
+    }
+    solver->addConstraint(typeOf(RECORD, solver),
+                          solver->types.getRecord(field_types), this);
+    TIPTypeError no_field([this]() {
+        return RECORD->print() + " has no field " + FIELD.str();
+    });
+    solver->requirePresent(getId(), no_field.locate(getId(), line, column));
+}
+
+/**
+ * Empty typechecks: nullexpr and errorstmt do not need typechecking
+ */
+void NullExpr::typecheck(UnionFindSolver* solver)
 {
     return;
 }
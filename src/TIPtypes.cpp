@@ -1,7 +1,24 @@
 #include "TIPtypes.h"
+#include <algorithm>
+
+TIPTypeError::TIPTypeError(std::string msg) : msg(msg), rendered(true) {}
+TIPTypeError::TIPTypeError(std::function<std::string()> render)
+    : render(std::move(render)) {}
+
+TIPTypeError& TIPTypeError::locate(int nodeId, int line, int column) {
+    if (!hasLocation()) {
+        this->nodeId = nodeId;
+        this->line = line;
+        this->column = column;
+    }
+    return *this;
+}
 
-TIPTypeError::TIPTypeError(std::string msg) : msg(msg) {}
 const char* TIPTypeError::what() const noexcept {
+    if (!rendered) {
+        msg = render();
+        rendered = true;
+    }
     return msg.c_str();
 }
 
@@ -10,7 +27,7 @@ std::string TIPint::print() const
     return "int";
 };
 
-TIPref::TIPref(TIPtype *of) : of(of) {}
+TIPref::TIPref(TIPtype *of) : TIPtype(TK_Ref), of(of) {}
 
 std::string TIPref::print() const
 {
@@ -26,9 +43,8 @@ std::string TIPalpha::print() const
     return ALPHA;
 }
 
-TIPfun::TIPfun(std::vector<TIPtype*> param_types, TIPtype* ret) : param_types(param_types), ret(ret){
-    this->composite = true;
-}
+TIPfun::TIPfun(std::vector<TIPtype*> param_types, TIPtype* ret)
+    : TIPtype(TK_Fun), param_types(param_types), ret(ret) {}
 
 std::string TIPfun::print() const 
 {
@@ -42,4 +58,98 @@ std::string TIPfun::print() const
     fun_type += ") -> ";
     fun_type += ret->print();
     return fun_type;
-}
\ No newline at end of file
+}
+
+std::string TIPabsent::print() const
+{
+    return "absent";
+}
+
+TIPrecord::TIPrecord(std::vector<TIPtype*> field_types,
+                     const std::vector<std::string>* field_names)
+    : TIPtype(TK_Record), field_names(field_names),
+      field_types(field_types) {}
+
+std::string TIPrecord::print() const
+{
+    //only the fields the record has are printed
+    std::string record_type = "{";
+    bool first = true;
+    for (int i = 0; i < field_types.size(); i++) {
+        if (llvm::isa<TIPabsent>(field_types[i])) {
+            continue;
+        }
+        if (!first) {
+            record_type += ",";
+        }
+        record_type += (*field_names)[i] + ":" + field_types[i]->print();
+        first = false;
+    }
+    record_type += "}";
+    return record_type;
+}
+
+std::string TIPvar::print() const
+{
+    return TIPalpha::ALPHA;
+}
+
+TIPtype* TIPtypeTable::getInt()
+{
+    return &intType;
+}
+
+TIPtype* TIPtypeTable::getAlpha()
+{
+    return &alphaType;
+}
+
+TIPref* TIPtypeTable::getRef(TIPtype* of)
+{
+    TIPref*& ref = refTypes[of];
+    if (ref == nullptr) {
+        ref = new (refArena.Allocate()) TIPref(of);
+    }
+    return ref;
+}
+
+TIPfun* TIPtypeTable::getFun(const std::vector<TIPtype*>& param_types, TIPtype* ret)
+{
+    TIPfun*& fun = funTypes[std::make_pair(param_types, ret)];
+    if (fun == nullptr) {
+        fun = new (funArena.Allocate()) TIPfun(param_types, ret);
+    }
+    return fun;
+}
+
+
+TIPtype* TIPtypeTable::getAbsent()
+{
+    return &absentType;
+}
+
+TIPrecord* TIPtypeTable::getRecord(const std::vector<TIPtype*>& field_types)
+{
+    TIPrecord*& record = recordTypes[field_types];
+    if (record == nullptr) {
+        record = new (recordArena.Allocate()) TIPrecord(field_types, &fieldNames);
+    }
+    return record;
+}
+
+void TIPtypeTable::setFieldNames(std::vector<std::string> names)
+{
+    fieldNames = std::move(names);
+}
+
+TIPvar* TIPtypeTable::getVar(int id)
+{
+    if (id >= (int)varTypes.size()) {
+        varTypes.resize(std::max<size_t>(id + 1, 2 * varTypes.size()));
+    }
+    TIPvar*& var = varTypes[id];
+    if (var == nullptr) {
+        var = new (varArena.Allocate()) TIPvar(id);
+    }
+    return var;
+}
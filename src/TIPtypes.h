@@ -1,45 +1,172 @@
 #pragma once
 
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/Casting.h"
+#include <functional>
+#include <map>
 #include <string>
+#include <utility>
 #include <vector>
 #include <sstream>
 #include <iostream>
 
+/*
+ * TIPTypeError - a type error, at a node of the program when it is known
+ *
+ * The message is rendered by a callback the first time it is asked for,
+ * so that nothing is printed unless the error is reported.  The callback
+ * may refer to nodes and types, which must outlive the error.
+ */
 class TIPTypeError : public std::exception {
-    std::string msg;
+    std::function<std::string()> render;
+    mutable std::string msg;
+    mutable bool rendered = false;
 public:
+    // the id and source location of the node, 0 when unknown
+    int nodeId = 0;
+    int line = 0;
+    int column = 0;
     TIPTypeError(std::string msg);
+    TIPTypeError(std::function<std::string()> render);
+    // locate the error at a node, unless it is already located
+    TIPTypeError& locate(int nodeId, int line, int column);
+    bool hasLocation() const { return line != 0; }
     virtual const char* what() const noexcept override;
 };
 
+/*
+ * Types are hash-consed by TIPtypeTable: structurally equal types are
+ * represented by a single object, so type equality is pointer equality.
+ * Type objects are only created through a table, which owns them.
+ *
+ * Each type records its kind, so it can be tested and cast with
+ * llvm::isa<> and llvm::dyn_cast<> rather than with RTTI.
+ */
 class TIPtype {
 public:
-    bool composite = false;
+    enum TypeKind {
+        TK_Int, TK_Ref, TK_Alpha, TK_Fun, TK_Absent, TK_Record, TK_Var
+    };
+private:
+    const TypeKind kind;
+protected:
+    TIPtype(TypeKind kind) : kind(kind) {}
+public:
+    TypeKind getKind() const { return kind; }
     virtual std::string print() const = 0;
 };
 
 class TIPint : public TIPtype {
 public:
+    TIPint() : TIPtype(TK_Int) {}
     std::string print() const override;
+    static bool classof(const TIPtype *t) { return t->getKind() == TK_Int; }
 };
 
 class TIPref : public TIPtype {
+    friend class TIPtypeTable;
+    TIPref(TIPtype *of);
 public:
     TIPtype *of;
-    TIPref(TIPtype *of);
     std::string print() const override;
+    static bool classof(const TIPtype *t) { return t->getKind() == TK_Ref; }
 };
 
 class TIPalpha : public TIPtype {
 public:
     static std::string ALPHA;
+    TIPalpha() : TIPtype(TK_Alpha) {}
     std::string print() const override;
+    static bool classof(const TIPtype *t) {
+        return t->getKind() == TK_Alpha;
+    }
 };
 
 class TIPfun : public TIPtype {
+    friend class TIPtypeTable;
+    TIPfun(std::vector<TIPtype*> param_types, TIPtype* ret);
 public:
     std::vector<TIPtype*> param_types;
     TIPtype* ret;
-    TIPfun(std::vector<TIPtype*> param_types, TIPtype* ret);
     std::string print() const override;
-};
\ No newline at end of file
+    static bool classof(const TIPtype *t) { return t->getKind() == TK_Fun; }
+};
+
+// The type of a field that a record does not have
+class TIPabsent : public TIPtype {
+public:
+    TIPabsent() : TIPtype(TK_Absent) {}
+    std::string print() const override;
+    static bool classof(const TIPtype *t) {
+        return t->getKind() == TK_Absent;
+    }
+};
+
+/*
+ * Every record has a component for each field of the program, by field
+ * index, which is absent for the fields the record does not have.
+ */
+class TIPrecord : public TIPtype {
+    friend class TIPtypeTable;
+    TIPrecord(std::vector<TIPtype*> field_types,
+              const std::vector<std::string>* field_names);
+    const std::vector<std::string>* field_names;
+public:
+    std::vector<TIPtype*> field_types;
+    std::string print() const override;
+    static bool classof(const TIPtype *t) {
+        return t->getKind() == TK_Record;
+    }
+};
+
+/*
+ * A type variable, standing for the type of the node with the same id, or
+ * for an unknown type introduced by a constraint.  Variables only appear
+ * in the constraints of the solver, never in the types that it infers.
+ */
+class TIPvar : public TIPtype {
+    friend class TIPtypeTable;
+    TIPvar(int id) : TIPtype(TK_Var), id(id) {}
+public:
+    const int id;
+    std::string print() const override;
+    static bool classof(const TIPtype *t) { return t->getKind() == TK_Var; }
+};
+
+/*
+ * TIPtypeTable - interns the types of one compilation.
+ *
+ * Every type is allocated from an arena owned by the table and is
+ * released in one shot when the table is destroyed.  Since the components
+ * of a composite type are already interned, a composite is identified by
+ * the pointers to its components.
+ */
+class TIPtypeTable {
+    TIPint intType;
+    TIPalpha alphaType;
+    TIPabsent absentType;
+    llvm::SpecificBumpPtrAllocator<TIPref> refArena;
+    llvm::SpecificBumpPtrAllocator<TIPfun> funArena;
+    llvm::SpecificBumpPtrAllocator<TIPrecord> recordArena;
+    llvm::SpecificBumpPtrAllocator<TIPvar> varArena;
+    std::map<TIPtype*, TIPref*> refTypes;
+    std::map<std::pair<std::vector<TIPtype*>, TIPtype*>, TIPfun*> funTypes;
+    std::map<std::vector<TIPtype*>, TIPrecord*> recordTypes;
+    // variables by id, which are dense
+    std::vector<TIPvar*> varTypes;
+    std::vector<std::string> fieldNames;
+public:
+    TIPtypeTable() = default;
+    TIPtypeTable(const TIPtypeTable&) = delete;
+    TIPtypeTable& operator=(const TIPtypeTable&) = delete;
+    TIPtype* getInt();
+    TIPtype* getAlpha();
+    TIPref* getRef(TIPtype* of);
+    TIPfun* getFun(const std::vector<TIPtype*>& param_types, TIPtype* ret);
+    TIPtype* getAbsent();
+    TIPrecord* getRecord(const std::vector<TIPtype*>& field_types);
+    TIPvar* getVar(int id);
+    // the field names of the program, by field index, set before typing
+    void setFieldNames(std::vector<std::string> names);
+    int numFields() const { return fieldNames.size(); }
+};
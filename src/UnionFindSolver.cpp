@@ -1,87 +1,319 @@
 #include "UnionFindSolver.h"
+#include "llvm/ADT/GraphTraits.h"
+#include "llvm/ADT/SCCIterator.h"
+#include <algorithm>
 
-int UnionFindSolver::findRoot(int node_id) 
+// The call graph, for visiting its strongly connected components
+namespace llvm {
+template <> struct GraphTraits<ConstraintGroup*> {
+    using NodeRef = ConstraintGroup*;
+    using ChildIteratorType = std::vector<ConstraintGroup*>::iterator;
+    static NodeRef getEntryNode(ConstraintGroup* group) { return group; }
+    static ChildIteratorType child_begin(NodeRef group) {
+        return group->callees.begin();
+    }
+    static ChildIteratorType child_end(NodeRef group) {
+        return group->callees.end();
+    }
+};
+}
+
+UnionFindSolver::UnionFindSolver()
+{
+    groups.emplace_back();
+}
+
+void UnionFindSolver::grow(int node_id)
+{
+    if (node_id >= (int)parent.size()) {
+        // grow geometrically so a pass over n ids costs O(n) reallocation
+        size_t size = std::max<size_t>(node_id + 1, 2 * parent.size());
+        parent.resize(size, -1);
+        rank.resize(size, 0);
+        binding.resize(size, nullptr);
+        resolved.resize(size, nullptr);
+        resolvedCut.resize(size, nullptr);
+        recursive.resize(size, false);
+        searched.resize(size, 0);
+    }
+}
+
+int UnionFindSolver::findRoot(int node_id)
 {
     addNode(node_id);
-    while (node2root[node_id] != node_id) {
-        node_id = node2root[node_id];
+    int root_id = node_id;
+    while (parent[root_id] != root_id) {
+        root_id = parent[root_id];
+    }
+    //path compression: point every node on the path directly at the root
+    while (parent[node_id] != root_id) {
+        int next_id = parent[node_id];
+        parent[node_id] = root_id;
+        node_id = next_id;
     }
-    return node_id;
+    return root_id;
 }
 
 void UnionFindSolver::addNode(int node_id)
 {
-    if (node2root.find(node_id) == node2root.end()) {
-        node2root[node_id] = node_id;
-    }
-    if (node2type.find(node_id) == node2type.end()) {
-        node2type[node_id] = new TIPalpha();
+    grow(node_id);
+    if (parent[node_id] == -1) {
+        parent[node_id] = node_id;
     }
 }
 
-void UnionFindSolver::unifyNodes(int nodex_id, int nodey_id)
+bool UnionFindSolver::existNode(int node_id)
+{
+    return node_id >= 0 && node_id < (int)parent.size() && parent[node_id] != -1;
+}
+
+int UnionFindSolver::unionNodes(int nodex_id, int nodey_id)
 {
-    addNode(nodex_id);
-    addNode(nodey_id);
     int rootx_id = findRoot(nodex_id);
     int rooty_id = findRoot(nodey_id);
     if (rootx_id == rooty_id) {
-        return;
+        return rootx_id;
+    }
+    //union by rank: hang the shallower tree below the deeper one
+    if (rank[rootx_id] > rank[rooty_id]) {
+        std::swap(rootx_id, rooty_id);
+    } else if (rank[rootx_id] == rank[rooty_id]) {
+        rank[rooty_id]++;
     }
-    //unify types
-    TIPtype* unified_type = unifyTypes(node2type[rootx_id], node2type[rooty_id]);
-    node2root[rootx_id] = rooty_id;
-    node2type[rooty_id] = unified_type;
+    parent[rootx_id] = rooty_id;
+    return rooty_id;
 }
 
-void UnionFindSolver::setType(int node_id, TIPtype* type) 
+void UnionFindSolver::setNumNodes(int numNodes)
 {
-    addNode(node_id);
-    int root_id = findRoot(node_id);
-    // unify types
-    TIPtype* unified_type = unifyTypes(node2type[root_id], type);
-    node2type[root_id] = unified_type;
+    nextFresh = numNodes;
 }
 
-TIPtype* UnionFindSolver::getType(int node_id) 
+void UnionFindSolver::addFunction(int fun_id)
 {
-    addNode(node_id);
-    int root_id = findRoot(node_id);
-    return node2type[root_id];
+    addNode(fun_id);
+    if (fun_id >= (int)funGroup.size()) {
+        funGroup.resize(fun_id + 1, 0);
+    }
+    funGroup[fun_id] = groups.size();
+    groups.emplace_back();
 }
 
-bool UnionFindSolver::existNode(int node_id)
+void UnionFindSolver::beginFunction(int fun_id)
 {
-    return node2root.find(node_id) != node2root.end();
+    current = funGroup[fun_id];
 }
 
-TIPtype* UnionFindSolver::unifyTypes(TIPtype* typex, TIPtype* typey)
+void UnionFindSolver::addReference(int node_id)
 {
-    if (typex->print() == typey->print()) {
-        //same type
-        return typex;
+    if (node_id < (int)funGroup.size() && funGroup[node_id] != 0) {
+        groups[current].callee_ids.push_back(node_id);
     }
-    if (typex->print() == TIPalpha::ALPHA) {
-        //x is untyped
-        return typey;
+}
+
+void UnionFindSolver::addConstraint(TIPtype* typex, TIPtype* typey,
+                                    TIPtree::AstNode* node)
+{
+    groups[current].constraints.push_back({typex, typey, node});
+}
+
+void UnionFindSolver::requirePresent(int node_id, TIPTypeError error)
+{
+    presentChecks.emplace_back(node_id, std::move(error));
+}
+
+void UnionFindSolver::solve()
+{
+    //group 0 reaches every function, so every component is visited
+    for (size_t g = 1; g < groups.size(); g++) {
+        groups[0].callees.push_back(&groups[g]);
+        for (int callee_id : groups[g].callee_ids) {
+            groups[g].callees.push_back(&groups[funGroup[callee_id]]);
+        }
     }
-    if (typey->print() == TIPalpha::ALPHA) {
-        //y is untyped
-        return typex;
+    //components are visited callees first
+    for (auto scc = llvm::scc_begin(&groups[0]); !scc.isAtEnd(); ++scc) {
+        for (ConstraintGroup* group : *scc) {
+            for (auto const& constraint : group->constraints) {
+                TIPtree::AstNode* node = constraint.node;
+                try {
+                    assumed.clear();
+                    unify(constraint.lhs, constraint.rhs);
+                } catch (TIPTypeError& e) {
+                    e.locate(node->getId(), node->line, node->column);
+                    throw;
+                }
+            }
+        }
     }
-    if (!typex->composite || !typey->composite) {
-        throw TIPTypeError("Cannot unify types " + typex->print() +" and " + typey->print());
+    for (auto const& check : presentChecks) {
+        if (getType(check.first) == types.getAbsent()) {
+            throw check.second;
+        }
     }
-    //unify functions
-    TIPfun* funx = dynamic_cast<TIPfun*>(typex);
-    TIPfun* funy = dynamic_cast<TIPfun*>(typey);
-    if (funx->param_types.size() != funy->param_types.size()) {
-        throw TIPTypeError("Cannot unify types " + typex->print() +" and " + typey->print());
+}
+
+// The binding of a variable, or its root when it is unbound
+TIPtype* UnionFindSolver::find(TIPtype* type)
+{
+    auto* var = llvm::dyn_cast<TIPvar>(type);
+    if (var == nullptr) {
+        return type;
     }
-    std::vector<TIPtype*> merged_param_types;
-    for (int i=0; i<funx->param_types.size(); i++) {
-        merged_param_types.push_back(unifyTypes(funx->param_types[i], funy->param_types[i]));
+    int root_id = findRoot(var->id);
+    if (binding[root_id] != nullptr) {
+        return binding[root_id];
     }
-    TIPtype* merged_ret = unifyTypes(funx->ret, funy->ret);
-    return new TIPfun(merged_param_types, merged_ret);
-}
\ No newline at end of file
+    return types.getVar(root_id);
+}
+
+// The types are interned by the solver, so they outlive the error
+TIPTypeError UnionFindSolver::unifyError(TIPtype* typex, TIPtype* typey)
+{
+    return TIPTypeError([this, typex, typey]() {
+        return "Cannot unify types " + resolve(typex)->print() + " and " +
+               resolve(typey)->print();
+    });
+}
+
+void UnionFindSolver::unify(TIPtype* typex, TIPtype* typey)
+{
+    typex = find(typex);
+    typey = find(typey);
+    if (typex == typey) {
+        //same type, types are interned so this is a structural comparison
+        return;
+    }
+    auto* varx = llvm::dyn_cast<TIPvar>(typex);
+    auto* vary = llvm::dyn_cast<TIPvar>(typey);
+    if (varx != nullptr && vary != nullptr) {
+        unionNodes(varx->id, vary->id);
+        return;
+    }
+    if (varx != nullptr) {
+        binding[varx->id] = typey;
+        return;
+    }
+    if (vary != nullptr) {
+        binding[vary->id] = typex;
+        return;
+    }
+    //recursive types are equal if their components are, assuming they are
+    if (!assumed.insert(std::make_pair(typex, typey)).second) {
+        return;
+    }
+    if (typex->getKind() != typey->getKind()) {
+        throw unifyError(typex, typey);
+    }
+    if (auto* refx = llvm::dyn_cast<TIPref>(typex)) {
+        unify(refx->of, llvm::cast<TIPref>(typey)->of);
+        return;
+    }
+    //every record has a component per field
+    if (auto* recx = llvm::dyn_cast<TIPrecord>(typex)) {
+        auto* recy = llvm::cast<TIPrecord>(typey);
+        for (int i=0; i<recx->field_types.size(); i++) {
+            unify(recx->field_types[i], recy->field_types[i]);
+        }
+        return;
+    }
+    if (auto* funx = llvm::dyn_cast<TIPfun>(typex)) {
+        auto* funy = llvm::cast<TIPfun>(typey);
+        if (funx->param_types.size() != funy->param_types.size()) {
+            throw unifyError(typex, typey);
+        }
+        for (int i=0; i<funx->param_types.size(); i++) {
+            unify(funx->param_types[i], funy->param_types[i]);
+        }
+        unify(funx->ret, funy->ret);
+        return;
+    }
+    //the other types are distinct constants
+    throw unifyError(typex, typey);
+}
+
+/*
+ * Mark classes whose types contain themselves, with a depth first search
+ * of the bindings: a class that is reached again while it is being
+ * searched closes a cycle.  Every cycle has such a class, so the types
+ * are finite once they are cut at the marked classes.  Classes are only
+ * searched once, and every class reachable from a searched class has
+ * been searched, so later searches cannot close a cycle through them.
+ */
+void UnionFindSolver::markRecursive(TIPtype* type)
+{
+    if (auto* var = llvm::dyn_cast<TIPvar>(type)) {
+        int root_id = findRoot(var->id);
+        if (binding[root_id] == nullptr || searched[root_id] == 2) {
+            return;
+        }
+        if (searched[root_id] == 1) {
+            recursive[root_id] = true;
+            return;
+        }
+        searched[root_id] = 1;
+        markRecursive(binding[root_id]);
+        searched[root_id] = 2;
+    } else if (auto* ref = llvm::dyn_cast<TIPref>(type)) {
+        markRecursive(ref->of);
+    } else if (auto* rec = llvm::dyn_cast<TIPrecord>(type)) {
+        for (TIPtype* field : rec->field_types) {
+            markRecursive(field);
+        }
+    } else if (auto* fun = llvm::dyn_cast<TIPfun>(type)) {
+        for (TIPtype* param : fun->param_types) {
+            markRecursive(param);
+        }
+        markRecursive(fun->ret);
+    }
+}
+
+/*
+ * The type with every variable replaced by its binding, or by alpha when
+ * it is unbound.  A recursive class is expanded once, with the recursive
+ * classes within it cut to alpha, so the type of every class is the same
+ * wherever its resolution starts and is cached, with each class resolved
+ * at most once with and once without the cut.
+ */
+TIPtype* UnionFindSolver::resolve(TIPtype* type, bool cutRecursive)
+{
+    if (auto* var = llvm::dyn_cast<TIPvar>(type)) {
+        int root_id = findRoot(var->id);
+        if (binding[root_id] == nullptr) {
+            return types.getAlpha();
+        }
+        markRecursive(var);
+        if (recursive[root_id] && cutRecursive) {
+            return types.getAlpha();
+        }
+        std::vector<TIPtype*> &cache = cutRecursive ? resolvedCut : resolved;
+        if (cache[root_id] == nullptr) {
+            cache[root_id] = resolve(binding[root_id],
+                                     cutRecursive || recursive[root_id]);
+        }
+        return cache[root_id];
+    }
+    if (auto* ref = llvm::dyn_cast<TIPref>(type)) {
+        return types.getRef(resolve(ref->of, cutRecursive));
+    }
+    if (auto* rec = llvm::dyn_cast<TIPrecord>(type)) {
+        std::vector<TIPtype*> field_types;
+        for (TIPtype* field : rec->field_types) {
+            field_types.push_back(resolve(field, cutRecursive));
+        }
+        return types.getRecord(field_types);
+    }
+    if (auto* fun = llvm::dyn_cast<TIPfun>(type)) {
+        std::vector<TIPtype*> param_types;
+        for (TIPtype* param : fun->param_types) {
+            param_types.push_back(resolve(param, cutRecursive));
+        }
+        return types.getFun(param_types, resolve(fun->ret, cutRecursive));
+    }
+    return type;
+}
+
+TIPtype* UnionFindSolver::getType(int node_id)
+{
+    return resolve(types.getVar(node_id));
+}
@@ -1,22 +1,104 @@
 #pragma once
 
-#include <map>
+#include <vector>
+#include <set>
 #include <sstream>
 #include <iostream>
 #include "TIPtree.h"
 #include "TIPtypes.h"
 
+// TypeConstraint - the types must be equal, raised by the node
+struct TypeConstraint {
+    TIPtype* lhs;
+    TIPtype* rhs;
+    TIPtree::AstNode* node;
+};
+
+// ConstraintGroup - the type constraints of one function
+struct ConstraintGroup {
+    std::vector<TypeConstraint> constraints;
+    // the functions that the function refers to, set when solving
+    std::vector<ConstraintGroup*> callees;
+    std::vector<int> callee_ids;
+};
+
+/*
+ * Constraint-based type inference.
+ *
+ * Typechecking a program collects the constraints between the types of
+ * its nodes, where the type of each node is the variable with the node's
+ * id, in a single walk.  The constraints are solved in one batch by
+ * unification.  Functions are solved in the order of the strongly
+ * connected components of the call graph, callees first, so that the
+ * type of a function is complete before its callers are checked.  This
+ * is where the type of a function could be generalized, but types are
+ * monomorphic.
+ *
+ * Unification is union-find over the variables.  Node ids produced by
+ * genId() are dense small integers, so the forest is stored in flat
+ * vectors indexed by id rather than in maps.  Roots are linked by rank
+ * and paths are compressed on every find, which keeps operations
+ * near-constant time.  Each class of variables may be bound to a type,
+ * which can contain variables, so types may be recursive.
+ */
 class UnionFindSolver {
-    //mapping from node to root 
-    std::map<int, int> node2root;
-    //mapping from node to type
-    std::map<int, TIPtype*> node2type;
-public: 
+    //parent of each variable, a root is its own parent, -1 if never added
+    std::vector<int> parent;
+    //upper bound on the height of the tree rooted at each variable
+    std::vector<int> rank;
+    //type bound to each class of variables, only at the root, or nullptr
+    std::vector<TIPtype*> binding;
+    //inferred type of each class, only at the root, cached by getType
+    std::vector<TIPtype*> resolved;
+    //the same with the recursive classes cut, for the recursive classes
+    std::vector<TIPtype*> resolvedCut;
+    //classes at which recursive types are cut, found by markRecursive
+    std::vector<bool> recursive;
+    //0 for classes not yet searched, 1 while searching, 2 once searched
+    std::vector<char> searched;
+    //group 0 refers to every function, the others hold one function each
+    std::vector<ConstraintGroup> groups;
+    //group of each function by id, 0 if the id is not a function
+    std::vector<int> funGroup;
+    int current = 0;
+    //checks run once the constraints are solved
+    std::vector<std::pair<int, TIPTypeError>> presentChecks;
+    int nextFresh = 0;
+    //pairs of types being unified, assumed equal for recursive types
+    std::set<std::pair<TIPtype*, TIPtype*>> assumed;
+    void grow(int node_id);
+    TIPtype* find(TIPtype* type);
+    void unify(TIPtype* typex, TIPtype* typey);
+    void markRecursive(TIPtype* type);
+    TIPtype* resolve(TIPtype* type, bool cutRecursive = false);
+    TIPTypeError unifyError(TIPtype* typex, TIPtype* typey);
+public:
+    //owner of every type the solver and typecheck routines create
+    TIPtypeTable types;
+    UnionFindSolver();
     int findRoot(int node_id);
     void addNode(int node_id);
-    void unifyNodes(int nodex_id, int nodey_id);
-    void setType(int node_id, TIPtype* type);
-    TIPtype* getType(int node_id);
-    TIPtype* unifyTypes(TIPtype* typex, TIPtype* typey);
     bool existNode(int node_id);
-};
\ No newline at end of file
+    //merge the classes of two nodes bound to no type, returns the new root
+    int unionNodes(int nodex_id, int nodey_id);
+
+    //the variables of the nodes are the ids below numNodes
+    void setNumNodes(int numNodes);
+    TIPvar* getVar(int node_id) { return types.getVar(node_id); }
+    TIPvar* freshVar() { return types.getVar(nextFresh++); }
+    //declare a function, before any constraints are added
+    void addFunction(int fun_id);
+    //add the constraints that follow to the function
+    void beginFunction(int fun_id);
+    //record a reference to the node id, which may name a function
+    void addReference(int node_id);
+    void addConstraint(TIPtype* typex, TIPtype* typey,
+                       TIPtree::AstNode* node);
+    //raise the error if the node is inferred to have an absent type
+    void requirePresent(int node_id, TIPTypeError error);
+    //solve the constraints, throws a TIPTypeError if they have no solution
+    void solve();
+
+    //the inferred type of a node, with unknown types as alpha
+    TIPtype* getType(int node_id);
+};
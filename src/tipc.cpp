@@ -1,12 +1,35 @@
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <stdlib.h>
+#include <sys/resource.h>
+#include <thread>
 
 #include "TIPLexer.h"
 #include "TIPParser.h"
+#include "TIPcache.h"
+#include "TIPemit.h"
+#include "TIPintrinsics.h"
+#include "TIPjit.h"
+#include "TIPprofile.h"
+#include "TIPsplit.h"
 #include "TIPtreeBuild.h"
 #include "TIPtreeGen.h"
+#include "UnionFindSolver.h"
 #include "antlr4-runtime.h"
+#include "llvm/Analysis/ScopedNoAliasAA.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Linker/Linker.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
 
 using namespace std;
 using namespace antlr4;
@@ -27,64 +50,928 @@ static cl::opt<bool> ppWlines("l", cl::desc("pretty print with line numbers"),
                               cl::cat(TIPcat));
 static cl::opt<bool> noOpt("d", cl::desc("disable bitcode optimization"),
                            cl::cat(TIPcat));
+static cl::opt<char>
+    optLevel("O",
+             cl::desc("optimization level, -O0, -O1, -O2 or -O3, that runs "
+                      "the full module pipeline for that level"),
+             cl::Prefix, cl::ZeroOrMore, cl::init(' '), cl::cat(TIPcat));
+static cl::opt<bool>
+    printPasses("print-passes",
+                cl::desc("print the structure of the pass pipeline"),
+                cl::cat(TIPcat));
 static cl::opt<std::string> sourceFile(cl::Positional,
                                        cl::desc("<tip source file>"),
                                        cl::Required, cl::cat(TIPcat));
 static cl::opt<bool> typecheck("t", cl::desc("type analysis"), cl::cat(TIPcat));
+static cl::opt<bool>
+    runProgram("run",
+               cl::desc("compile the program in memory and run it, any "
+                        "remaining arguments are passed to its main"),
+               cl::cat(TIPcat));
+static cl::opt<bool>
+    emitObject("c", cl::desc("compile to a native object file"),
+               cl::cat(TIPcat));
+static cl::opt<std::string>
+    outputFile("o",
+               cl::desc("output file, an executable unless -c is given"),
+               cl::value_desc("file"), cl::cat(TIPcat));
+static cl::opt<std::string>
+    targetArch("march",
+               cl::desc("architecture to generate native code for, "
+                        "defaults to the host"),
+               cl::cat(TIPcat));
+static cl::opt<std::string>
+    targetCPU("mcpu",
+              cl::desc("cpu to generate native code for, \"native\" "
+                       "selects the host cpu and all of its extensions"),
+              cl::cat(TIPcat));
+static cl::opt<std::string>
+    intrinsicsLib("intrinsics",
+                  cl::desc("intrinsics library linked into executables"),
+                  cl::value_desc("file"), cl::init(TIP_INTRINSICS_LIB),
+                  cl::cat(TIPcat));
+static cl::opt<bool>
+    useGC("gc",
+          cl::desc("allocate from a garbage collected heap, for long "
+                   "running programs"),
+          cl::cat(TIPcat));
+static cl::list<std::string>
+    extraArgs(cl::Positional, cl::ZeroOrMore,
+              cl::desc("<more tip source files>... or, with -run, "
+                       "<program arguments>... (use -- before negative "
+                       "arguments)"),
+              cl::cat(TIPcat));
+static cl::opt<unsigned>
+    numJobs("j",
+            cl::desc("compile this many source files at once, 0 uses a "
+                     "thread for each hardware thread"),
+            cl::value_desc("N"), cl::init(1), cl::cat(TIPcat));
+static cl::opt<unsigned> numPartitions(
+    "split",
+    cl::desc("split the module into N partitions of its functions that are "
+             "optimized and emitted in parallel"),
+    cl::value_desc("N"), cl::init(1), cl::cat(TIPcat));
+static cl::opt<std::string>
+    cacheDir("cache-dir",
+             cl::desc("reuse the files compiled from identical sources "
+                      "with the same options, keeping them in this "
+                      "directory"),
+             cl::value_desc("dir"), cl::cat(TIPcat));
+static cl::opt<bool>
+    timePhases("time-phases",
+               cl::desc("report the wall time, cpu time and memory of each "
+                        "compilation phase and of each LLVM pass"),
+               cl::cat(TIPcat));
+static cl::opt<std::string>
+    timePhasesJSON("time-phases-json",
+                   cl::desc("write the -time-phases report as JSON to this "
+                            "file"),
+                   cl::value_desc("file"), cl::cat(TIPcat));
+static cl::opt<bool>
+    parseByFunction("parse-by-function",
+                    cl::desc("parse and build one function at a time, "
+                             "freeing the parse tree of each function once "
+                             "it is built"),
+                    cl::cat(TIPcat));
+static cl::opt<bool>
+    profileGenerate("fprofile-generate",
+                    cl::desc("count the calls and branches of the program "
+                             "and write them to a profile when it exits, "
+                             "to $TIP_PROFILE_FILE or tip.profile"),
+                    cl::cat(TIPcat));
+static cl::opt<std::string>
+    profileUse("fprofile-use",
+               cl::desc("optimize the program for the counts of a profile "
+                        "written by the program compiled with "
+                        "-fprofile-generate"),
+               cl::value_desc("file"), cl::cat(TIPcat));
+static cl::opt<bool>
+    instrument("instrument",
+               cl::desc("count the calls and cycles of each function and "
+                        "report them on stderr when the program exits"),
+               cl::cat(TIPcat));
+static cl::opt<bool>
+    linkIntrinsicsBitcode("link-intrinsics",
+                          cl::desc("link the bitcode of the intrinsics into "
+                                   "the module before optimizing it, so "
+                                   "that the output is the whole program"),
+                          cl::cat(TIPcat));
+static cl::opt<bool>
+    memoize("memoize",
+            cl::desc("remember the results of the calls of functions "
+                     "without side effects, in a bounded table for each "
+                     "function"),
+            cl::cat(TIPcat));
+static cl::opt<bool>
+    pointsTo("points-to",
+             cl::desc("tell the optimizer which loads and stores cannot "
+                      "alias, from a unification based points-to analysis"),
+             cl::cat(TIPcat));
+static cl::opt<bool>
+    escapeAnalysis("escape-analysis",
+                   cl::desc("allocate the cells of alloc that cannot "
+                            "outlive the call that allocates them on the "
+                            "stack"),
+                   cl::cat(TIPcat));
 
-int main(int argc, const char *argv[]) {
-  cl::HideUnrelatedOptions(TIPcat); // suppress non TIP options
-  cl::ParseCommandLineOptions(argc, argv, "tipc - a TIP to llvm compiler\n");
+/*
+ * The simplification pipeline that is run when no optimization level
+ * is given; it promotes the allocas of the generated code to registers
+ * and cleans up the result.
+ */
+static void runSimplificationPasses(Module &theModule) {
+  // Create a pass manager to simplify generated module
+  auto TheFPM = llvm::make_unique<legacy::FunctionPassManager>(&theModule);
+
+  // Use the alias scopes of the points-to analysis.
+  TheFPM->add(createScopedNoAliasAAWrapperPass());
+  // Promote allocas to registers.
+  TheFPM->add(createPromoteMemoryToRegisterPass());
+  // Do simple "peephole" optimizations
+  TheFPM->add(createInstructionCombiningPass());
+  // Reassociate expressions.
+  TheFPM->add(createReassociatePass());
+  // Eliminate Common SubExpressions.
+  TheFPM->add(createGVNPass());
+  // Simplify the control flow graph (deleting unreachable blocks, etc).
+  TheFPM->add(createCFGSimplificationPass());
+  TheFPM->doInitialization();
+
+  // run simplification pass on each function
+  for (auto &fun : theModule.getFunctionList()) {
+    TheFPM->run(fun);
+  }
+  TheFPM->doFinalization();
+}
+
+/*
+ * Run the standard per-function and module pipelines for an optimization
+ * level.  These are populated by the PassManagerBuilder exactly as clang
+ * does, so -O2 and -O3 include the inliner, IPSCCP, tail call elimination,
+ * LICM, loop unrolling and the loop and SLP vectorizers.
+ */
+static void runOptimizationPipeline(Module &theModule, unsigned level,
+                                    TargetMachine *TM) {
+  PassManagerBuilder builder;
+  builder.OptLevel = level;
+  builder.SizeLevel = 0;
+  if (level > 1) {
+    builder.Inliner = createFunctionInliningPass(level, 0, false);
+  } else {
+    builder.Inliner = createAlwaysInlinerLegacyPass();
+  }
+  builder.DisableUnrollLoops = (level == 0);
+  builder.LoopVectorize = (level > 1);
+  builder.SLPVectorize = (level > 1);
+  builder.LibraryInfo =
+      new TargetLibraryInfoImpl(Triple(theModule.getTargetTriple()));
+
+  if (TM != nullptr) {
+    TM->adjustPassManager(builder);
+  }
+
+  legacy::FunctionPassManager functionPasses(&theModule);
+  legacy::PassManager modulePasses;
+  if (TM != nullptr) {
+    // let the vectorizers and unroller see the real target costs
+    functionPasses.add(
+        createTargetTransformInfoWrapperPass(TM->getTargetIRAnalysis()));
+    modulePasses.add(
+        createTargetTransformInfoWrapperPass(TM->getTargetIRAnalysis()));
+  }
+  builder.populateFunctionPassManager(functionPasses);
+  builder.populateModulePassManager(modulePasses);
+
+  functionPasses.doInitialization();
+  for (auto &fun : theModule) {
+    functionPasses.run(fun);
+  }
+  functionPasses.doFinalization();
+
+  modulePasses.run(theModule);
+}
+
+/*
+ * A source file to compile and the results of compiling it.  Text for
+ * stdout and stderr is collected here, rather than printed as it is
+ * produced, so the output of files compiled concurrently is not
+ * interleaved.
+ */
+struct CompileJob {
+  std::string sourceFile;
+  std::string output;
+  std::string errors;
+  int status = 0;
+};
+
+/*
+ * The name of a timer group is part of the keys of the JSON report, which
+ * are not escaped, so only the characters of plain paths are kept.
+ */
+static std::string getTimerGroupName(const std::string &group) {
+  std::string name = group;
+  for (char &c : name) {
+    if (!isalnum(static_cast<unsigned char>(c)) && c != '.' && c != '/' &&
+        c != '-' && c != '_') {
+      c = '_';
+    }
+  }
+  return name;
+}
+
+/*
+ * Times the enclosing scope as a phase of compiling a source file, with
+ * -time-phases.  The phases of each file, or of each partition of a file,
+ * are in a timer group of their own.  The cpu times of the timers are
+ * those of the whole process, so phases are only timed on one thread.
+ */
+class PhaseTimer : public NamedRegionTimer {
+public:
+  PhaseTimer(StringRef name, StringRef description, const std::string &group)
+      : NamedRegionTimer(name, description, getTimerGroupName(group),
+                         "tipc phases of " + group,
+                         timePhases || !timePhasesJSON.empty()) {}
+};
+
+/*
+ * A character stream over the bytes of a source file, which is read by
+ * the lexer in place.  ANTLR's own input stream decodes the whole file
+ * into a buffer of UTF-32 code points, four times the size of the file.
+ * TIP sources are ASCII, a byte that is not is a character of its own,
+ * which can only appear in a comment.
+ */
+class ByteCharStream : public CharStream {
+  StringRef bytes;
+  std::string name;
+  size_t p = 0;
+
+public:
+  ByteCharStream(StringRef bytes, const std::string &name)
+      : bytes(bytes), name(name) {}
+
+  void consume() override {
+    if (p >= bytes.size()) {
+      throw IllegalStateException("cannot consume EOF");
+    }
+    p++;
+  }
+
+  // LA(1) is the next character and LA(-1) the previous one
+  size_t LA(ssize_t i) override {
+    if (i == 0) {
+      return 0;
+    }
+    ssize_t position = static_cast<ssize_t>(p) + (i < 0 ? i : i - 1);
+    if (position < 0 || position >= static_cast<ssize_t>(bytes.size())) {
+      return IntStream::EOF;
+    }
+    return static_cast<unsigned char>(bytes[position]);
+  }
+
+  // the whole file is in memory so marks need not keep anything
+  ssize_t mark() override { return -1; }
+  void release(ssize_t marker) override {}
+
+  size_t index() override { return p; }
+  void seek(size_t index) override { p = std::min(index, bytes.size()); }
+  size_t size() override { return bytes.size(); }
+
+  std::string getSourceName() const override {
+    return name.empty() ? IntStream::UNKNOWN_SOURCE_NAME : name;
+  }
+
+  std::string getText(const misc::Interval &interval) override {
+    if (interval.a < 0 || interval.b < interval.a ||
+        static_cast<size_t>(interval.a) >= bytes.size()) {
+      return "";
+    }
+    size_t stop = std::min<size_t>(interval.b, bytes.size() - 1);
+    return bytes.slice(interval.a, stop + 1).str();
+  }
+
+  std::string toString() const override { return bytes.str(); }
+};
+
+/*
+ * Parse a rule from the current position of the tokens with ANTLR's two
+ * stage strategy.  The first stage uses SLL prediction, which is much
+ * faster and succeeds for almost all inputs, and gives up at the first
+ * error.  Only then is the rule parsed again with full LL prediction,
+ * which also reports the syntax errors.  The parse tree is owned by the
+ * parser that is left in parser.
+ */
+template <typename Context>
+static Context *parseTwoStage(CommonTokenStream &tokens,
+                              Context *(TIPParser::*rule)(),
+                              std::unique_ptr<TIPParser> &parser) {
+  // looking ahead sets up the stream, so that its index is valid
+  tokens.LA(1);
+  size_t start = tokens.index();
 
-  std::ifstream stream;
-  stream.open(sourceFile);
+  parser = llvm::make_unique<TIPParser>(&tokens);
+  parser->getInterpreter<atn::ParserATNSimulator>()->setPredictionMode(
+      atn::PredictionMode::SLL);
+  parser->removeErrorListeners();
+  parser->setErrorHandler(std::make_shared<BailErrorStrategy>());
+  try {
+    return (parser.get()->*rule)();
+  } catch (ParseCancellationException &) {
+    tokens.seek(start);
+    parser = llvm::make_unique<TIPParser>(&tokens);
+    return (parser.get()->*rule)();
+  }
+}
 
-  ANTLRInputStream input(stream);
+/*
+ * Parse the source file and build its tree.  The lexer is driven by the
+ * parser, so they are timed together.  With -parse-by-function each
+ * function is parsed on its own, by a parser that is destroyed along with
+ * the parse tree of the function once the function is built.
+ */
+static std::unique_ptr<Program> parseProgram(CommonTokenStream &tokens,
+                                             const std::string &group) {
+  TIPtreeBuild tb;
+  if (!parseByFunction) {
+    std::unique_ptr<TIPParser> parser;
+    TIPParser::ProgramContext *tree;
+    {
+      PhaseTimer timer("parse", "Lexing and parsing", group);
+      tree = parseTwoStage(tokens, &TIPParser::program, parser);
+    }
+    PhaseTimer timer("build", "Building the tree", group);
+    return tb.build(tree);
+  }
+
+  tb.beginProgram();
+  // a program is the functions up to the first token that is not a name
+  while (tokens.LA(1) == TIPParser::IDENTIFIER) {
+    std::unique_ptr<TIPParser> parser;
+    TIPParser::FunctionContext *tree;
+    {
+      PhaseTimer timer("parse", "Lexing and parsing", group);
+      tree = parseTwoStage(tokens, &TIPParser::function, parser);
+    }
+    PhaseTimer timer("build", "Building the tree", group);
+    tb.addFunction(tree);
+  }
+  return tb.endProgram();
+}
+
+/*
+ * Parse the source file and generate its module in TheContext, or only
+ * pretty print the program, in which case nullptr is returned.  Returns
+ * nullptr with a status of 1 if the file cannot be read.
+ */
+static std::unique_ptr<Module> generateModule(LLVMContext &TheContext,
+                                              CompileJob &job) {
+  // large files are memory mapped rather than read, and lexed in place
+  auto source = MemoryBuffer::getFile(job.sourceFile);
+  if (!source) {
+    job.errors += "tipc: unable to read " + job.sourceFile + ": " +
+                  source.getError().message() + "\n";
+    job.status = 1;
+    return nullptr;
+  }
+  ByteCharStream input((*source)->getBuffer(), job.sourceFile);
   TIPLexer lexer(&input);
   CommonTokenStream tokens(&lexer);
-  TIPParser parser(&tokens);
-
-  TIPParser::ProgramContext *tree = parser.program();
+  std::unique_ptr<Program> ast = parseProgram(tokens, job.sourceFile);
 
-  TIPtreeBuild tb(&parser);
-  auto ast = tb.build(tree);
-  
+  /*
+   * The solver owns the inferred types, which code generation uses to
+   * lower values to their types.  If type inference fails the program is
+   * still compiled, with the untyped lowering.
+   */
+  UnionFindSolver solver;
+  bool typed = false;
+  bool numbered = false;
   if (typecheck) {
-    ast->genId();
-    std::cout << ast->printTyped() << std::endl;
+    try {
+      {
+        PhaseTimer timer("genId", "Numbering the nodes", job.sourceFile);
+        ast->genId();
+        numbered = true;
+      }
+      {
+        PhaseTimer timer("typecheck", "Type inference", job.sourceFile);
+        ast->typecheck(&solver);
+      }
+      job.output += ast->printTyped(&solver) + "\n";
+      typed = true;
+    } catch (const TIPTypeError &e) {
+      // the message refers to the program, so it is rendered while it lives
+      std::string location;
+      if (e.hasLocation()) {
+        location = job.sourceFile + ":" + std::to_string(e.line) + ":" +
+                   std::to_string(e.column) + ": ";
+      }
+      job.errors += "tipc: " + location + "type error: " +
+                    std::string(e.what()) +
+                    ", falling back to untyped code generation\n";
+    }
   }
 
   if (pp || ppWlines) {
-    std::cout << ast->print("  ", ppWlines);
+    job.output += ast->print("  ", ppWlines);
+    return nullptr;
+  }
+
+  // the points-to analysis refers to the nodes by their ids
+  if ((pointsTo || escapeAnalysis) && !typecheck) {
+    try {
+      PhaseTimer timer("genId", "Numbering the nodes", job.sourceFile);
+      ast->genId();
+      numbered = true;
+    } catch (const TIPTypeError &e) {
+      job.errors += "tipc: " + std::string(e.what()) +
+                    ", compiling without the points-to analysis\n";
+    }
+  }
+
+  /*
+   * A profile only applies to the source that it was collected from, a
+   * profile of any other source is ignored.
+   */
+  TIPprofile profile;
+  if (profileGenerate) {
+    profile.mode = TIPprofile::Generate;
+    profile.hash = getProfileHash((*source)->getBuffer());
+  } else if (!profileUse.empty()) {
+    std::string error;
+    if (!readProfile(profileUse, profile, error)) {
+      job.errors += "tipc: " + error + ", ignoring the profile\n";
+      profile.mode = TIPprofile::None;
+    } else if (profile.hash != getProfileHash((*source)->getBuffer())) {
+      job.errors += "tipc: profile " + profileUse + " is not a profile of " +
+                    job.sourceFile + ", ignoring the profile\n";
+      profile.mode = TIPprofile::None;
+    }
+  }
+
+  CodegenOptions options;
+  options.useGC = useGC;
+  options.solver = typed ? &solver : nullptr;
+  options.profile = &profile;
+  options.instrument = instrument;
+  options.memoize = memoize;
+  options.aliasScopes = pointsTo && numbered;
+  options.stackAllocs = escapeAnalysis && numbered;
+
+  PhaseTimer timer("codegen", "Code generation", job.sourceFile);
+  return ast->codegen(TheContext, job.sourceFile, options);
+}
+
+// Run the optimizations selected on the command line
+static void optimizeModule(Module &theModule, TargetMachine *TM,
+                           const std::string &timerGroup) {
+  PhaseTimer timer("optimize", "Optimization", timerGroup);
+  if (noOpt) {
+    // leave the generated code as is
+  } else if (optLevel == ' ') {
+    runSimplificationPasses(theModule);
   } else {
-    auto theModule = ast->codegen(sourceFile);
-
-    if (!noOpt) {
-      // Create a pass manager to simplify generated module
-      auto TheFPM =
-          llvm::make_unique<legacy::FunctionPassManager>(theModule.get());
-
-      // Promote allocas to registers.
-      TheFPM->add(createPromoteMemoryToRegisterPass());
-      // Do simple "peephole" optimizations
-      TheFPM->add(createInstructionCombiningPass());
-      // Reassociate expressions.
-      TheFPM->add(createReassociatePass());
-      // Eliminate Common SubExpressions.
-      TheFPM->add(createGVNPass());
-      // Simplify the control flow graph (deleting unreachable blocks, etc).
-      TheFPM->add(createCFGSimplificationPass());
-      TheFPM->doInitialization();
-
-      // run simplification pass on each function
-      for (auto &fun : theModule->getFunctionList()) {
-        TheFPM->run(fun);
+    runOptimizationPipeline(theModule, optLevel - '0', TM);
+  }
+}
+
+// Write the module as a bitcode file
+static void writeBitcodeFile(Module &theModule, const std::string &file,
+                             const std::string &timerGroup) {
+  PhaseTimer timer("bitcode", "Writing bitcode", timerGroup);
+  std::error_code ec;
+  ToolOutputFile result(file, ec, sys::fs::F_None);
+  WriteBitcodeToFile(theModule, result.os());
+  result.keep();
+}
+
+/*
+ * Compile the module as partitions of its functions that are optimized,
+ * and emitted, on separate threads.  The object files of the partitions
+ * are combined into a single object file, while bitcode partitions are
+ * linked back into a single module.  Functions are only inlined within
+ * their partition.
+ */
+static bool compilePartitioned(LLVMContext &TheContext,
+                               std::unique_ptr<Module> theModule,
+                               CompileJob &job,
+                               const std::string &compiledFile) {
+  const std::string &sourceFile = job.sourceFile;
+  bool emitNative = emitObject || !outputFile.empty();
+  std::vector<std::string> objectFiles(numPartitions);
+  std::vector<SmallString<0>> bitcodeFiles(numPartitions);
+  // the problems of each partition, which is compiled on its own thread
+  std::vector<std::string> errors(numPartitions);
+  std::atomic<bool> failed(false);
+
+  unsigned numParts = forEachPartition(
+      std::move(theModule), numPartitions, [&](Module &part, unsigned p) {
+        std::string timerGroup = sourceFile + " part " + std::to_string(p);
+
+        // target machines are not thread safe so each partition has one
+        std::unique_ptr<TargetMachine> TM;
+        if (emitNative) {
+          TM = createTIPTargetMachine(targetArch, targetCPU,
+                                      optLevel == ' ' ? 2 : optLevel - '0',
+                                      errors[p]);
+          if (!TM) {
+            failed = true;
+            return;
+          }
+        }
+
+        optimizeModule(part, TM.get(), timerGroup);
+
+        if (!emitNative) {
+          PhaseTimer timer("bitcode", "Writing bitcode", timerGroup);
+          raw_svector_ostream os(bitcodeFiles[p]);
+          WriteBitcodeToFile(part, os);
+          return;
+        }
+
+        SmallString<128> objectFile;
+        if (sys::fs::createTemporaryFile("tipc", "o", objectFile)) {
+          errors[p] = "unable to create a temporary object file";
+          failed = true;
+          return;
+        }
+        objectFiles[p] = objectFile.str().str();
+        PhaseTimer timer("emit", "Emitting native code", timerGroup);
+        if (!emitObjectFile(part, *TM, objectFiles[p], errors[p])) {
+          failed = true;
+        }
+      });
+  objectFiles.resize(numParts);
+  bitcodeFiles.resize(numParts);
+  for (auto const &error : errors) {
+    if (!error.empty()) {
+      job.errors += "tipc: " + error + "\n";
+    }
+  }
+
+  if (!emitNative) {
+    if (failed) {
+      return false;
+    }
+
+    PhaseTimer timer("relink", "Linking the partitions", sourceFile);
+    std::unique_ptr<Module> linked;
+    std::unique_ptr<Linker> linker;
+    for (auto &bitcode : bitcodeFiles) {
+      auto part = parseBitcodeFile(
+          MemoryBufferRef(bitcode.str(), compiledFile), TheContext);
+      if (!part) {
+        job.errors += "tipc: unable to read a partition: " +
+                      toString(part.takeError()) + "\n";
+        return false;
+      }
+      if (!linked) {
+        linked = std::move(*part);
+        linker = llvm::make_unique<Linker>(*linked);
+      } else if (linker->linkInModule(std::move(*part))) {
+        job.errors += "tipc: unable to link the partitions\n";
+        return false;
       }
     }
+    writeBitcodeFile(*linked, compiledFile, sourceFile);
+    return true;
+  }
 
+  bool combined = false;
+  if (!failed) {
+    PhaseTimer timer("relink", "Linking the partitions", sourceFile);
+    std::string error;
+    combined = linkRelocatable(objectFiles, compiledFile, error);
+    if (!combined) {
+      job.errors += "tipc: " + error + "\n";
+    }
+  }
+  for (auto const &objectFile : objectFiles) {
+    if (!objectFile.empty()) {
+      sys::fs::remove(objectFile);
+    }
+  }
+  return combined;
+}
+
+/*
+ * Compile a source file to compiledFile, an object file for -c or -o,
+ * and otherwise a bitcode file.  Each file is compiled in its own
+ * LLVMContext, with its own target machine, so that files can be
+ * compiled on separate threads.
+ */
+static bool compileModule(CompileJob &job, const std::string &compiledFile) {
+  LLVMContext TheContext;
+  auto theModule = generateModule(TheContext, job);
+  if (!theModule) {
+    return false;
+  }
+
+  bool emitNative = emitObject || !outputFile.empty();
+  std::unique_ptr<TargetMachine> TM;
+  if (emitNative) {
+    std::string error;
+    TM = createTIPTargetMachine(targetArch, targetCPU,
+                                optLevel == ' ' ? 2 : optLevel - '0', error);
+    if (!TM) {
+      job.errors += "tipc: " + error + "\n";
+      return false;
+    }
+    theModule->setTargetTriple(TM->getTargetTriple().getTriple());
+    theModule->setDataLayout(TM->createDataLayout());
+  }
+
+  if (linkIntrinsicsBitcode) {
+    PhaseTimer timer("link-intrinsics", "Linking the intrinsics",
+                     job.sourceFile);
+    std::string error;
+    if (!linkIntrinsics(*theModule, error)) {
+      job.errors += "tipc: " + error + "\n";
+      return false;
+    }
+  }
+
+  if (numPartitions > 1) {
+    return compilePartitioned(TheContext, std::move(theModule), job,
+                              compiledFile);
+  }
+
+  optimizeModule(*theModule, TM.get(), job.sourceFile);
+
+  if (emitNative) {
+    PhaseTimer timer("emit", "Emitting native code", job.sourceFile);
+    std::string error;
+    if (!emitObjectFile(*theModule, *TM, compiledFile, error)) {
+      job.errors += "tipc: " + error + "\n";
+      return false;
+    }
+    return true;
+  }
+
+  writeBitcodeFile(*theModule, compiledFile, job.sourceFile);
+  return true;
+}
+
+/*
+ * The options that determine the file compiled from a source, which are
+ * part of its cache key.  Native code for "native" depends on the host.
+ */
+static std::string getCacheOptions() {
+  std::string options;
+  raw_string_ostream os(options);
+  os << "d=" << noOpt << " O=" << optLevel << " t=" << typecheck
+     << " gc=" << useGC << " split=" << numPartitions
+     << " instrument=" << instrument << " memoize=" << memoize
+     << " link-intrinsics=" << linkIntrinsicsBitcode
+     << " points-to=" << pointsTo << " escape-analysis=" << escapeAnalysis;
+  if (profileGenerate) {
+    os << " fprofile-generate";
+  } else if (!profileUse.empty()) {
+    // the code depends on the counts rather than the name of the profile
+    auto profile = MemoryBuffer::getFile(profileUse);
+    os << " fprofile-use=" << (profile ? MD5Hash((*profile)->getBuffer()) : 0);
+  }
+  if (emitObject || !outputFile.empty()) {
+    os << " march=" << targetArch << " mcpu=" << targetCPU;
+    if (targetCPU == "native") {
+      os << " host=" << sys::getHostCPUName();
+    }
+  }
+  return os.str();
+}
+
+/*
+ * Compile a source file through to its output: an object file with -c,
+ * an executable with -o, and otherwise a bitcode file.  With a cache
+ * directory the compiled file is taken from the cache when the source
+ * has been compiled with the same options before.
+ */
+static void compileFile(CompileJob &job) {
+  if (pp || ppWlines) {
+    LLVMContext TheContext;
+    generateModule(TheContext, job);
+    return;
+  }
+
+  // executables are linked from an object file that is compiled first
+  bool emitNative = emitObject || !outputFile.empty();
+  std::string compiledFile;
+  if (emitObject) {
+    compiledFile =
+        outputFile.empty() ? job.sourceFile + ".o" : std::string(outputFile);
+  } else if (emitNative) {
+    SmallString<128> objectFile;
+    if (sys::fs::createTemporaryFile("tipc", "o", objectFile)) {
+      job.errors += "tipc: unable to create a temporary object file\n";
+      job.status = 1;
+      return;
+    }
+    compiledFile = objectFile.str().str();
+  } else {
+    compiledFile = job.sourceFile + ".bc";
+  }
+
+  std::string key;
+  std::string suffix = emitNative ? ".o" : ".bc";
+  bool cached = false;
+  if (!cacheDir.empty()) {
+    PhaseTimer timer("cache", "Cache lookup", job.sourceFile);
+    if (auto source = MemoryBuffer::getFile(job.sourceFile)) {
+      key = getCacheKey((*source)->getBuffer(), getCacheOptions());
+      cached = lookupCache(cacheDir, key, suffix, compiledFile, job.output);
+    }
+  }
+
+  bool compiled = cached || compileModule(job, compiledFile);
+
+  // compilations that report problems are repeated so they report them
+  if (compiled && !cached && !key.empty() && job.errors.empty()) {
+    PhaseTimer timer("cache-store", "Cache store", job.sourceFile);
+    storeCache(cacheDir, key, suffix, compiledFile, job.output);
+  }
+
+  if (emitNative && !emitObject) {
+    PhaseTimer timer("link", "Linking the executable", job.sourceFile);
+    // a module that holds the intrinsics is the whole program
+    std::string intrinsics;
+    if (!linkIntrinsicsBitcode) {
+      intrinsics = intrinsicsLib;
+    }
+    std::string error;
+    if (compiled && !linkExecutable({compiledFile}, intrinsics, outputFile,
+                                    error)) {
+      job.errors += "tipc: " + error + "\n";
+      compiled = false;
+    }
+    sys::fs::remove(compiledFile);
+  }
+  job.status = compiled ? 0 : 1;
+}
+
+/*
+ * Report the phase and pass timers, as a table on stderr or as JSON.
+ * The memory of a phase is the growth of the heap while it ran, the JSON
+ * also records the peak resident set size of the process.
+ */
+static void reportPhaseTimes() {
+  if (!timePhasesJSON.empty()) {
     std::error_code ec;
-    ToolOutputFile result(sourceFile + ".bc", ec, sys::fs::F_None);
-    WriteBitcodeToFile(*theModule, result.os());
+    ToolOutputFile result(timePhasesJSON, ec, sys::fs::F_Text);
+    if (ec) {
+      errs() << "tipc: " << timePhasesJSON << ": " << ec.message() << "\n";
+      return;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    result.os() << "{\n";
+    const char *delim = TimerGroup::printAllJSONValues(result.os(), "");
+    result.os() << delim << "\t\"tipc.peak-rss-kb\": " << usage.ru_maxrss
+                << "\n}\n";
     result.keep();
   }
+
+  if (timePhases) {
+    TimerGroup::printAll(errs());
+  }
+}
+
+int main(int argc, const char *argv[]) {
+  cl::HideUnrelatedOptions(TIPcat); // suppress non TIP options
+  cl::ParseCommandLineOptions(argc, argv, "tipc - a TIP to llvm compiler\n");
+
+  if (optLevel != ' ' && (optLevel < '0' || optLevel > '3')) {
+    errs() << "tipc: invalid optimization level -O" << optLevel << "\n";
+    return 1;
+  }
+
+  if (runProgram && (emitObject || !outputFile.empty())) {
+    errs() << "tipc: -run cannot be combined with -c or -o\n";
+    return 1;
+  }
+
+  if (profileGenerate && !profileUse.empty()) {
+    errs() << "tipc: -fprofile-generate cannot be combined with "
+              "-fprofile-use\n";
+    return 1;
+  }
+
+  // the profile and the report are written by the main of the intrinsics
+  if (runProgram && (profileGenerate || instrument)) {
+    errs() << "tipc: -run cannot be combined with -fprofile-generate or "
+              "-instrument\n";
+    return 1;
+  }
+
+  if (linkIntrinsicsBitcode && !hasIntrinsicsBitcode()) {
+    errs() << "tipc: -link-intrinsics is unavailable, tipc was built "
+              "without clang and llvm-link of its LLVM version\n";
+    return 1;
+  }
+
+  // the JIT binds its own intrinsics
+  if (runProgram && linkIntrinsicsBitcode) {
+    errs() << "tipc: -run cannot be combined with -link-intrinsics\n";
+    return 1;
+  }
+
+  if (runProgram && numPartitions > 1) {
+    errs() << "tipc: -run cannot be combined with -split\n";
+    return 1;
+  }
+
+  // the timers, and the pass timers they share, measure the whole process
+  bool timing = timePhases || !timePhasesJSON.empty();
+  if (timing && numPartitions > 1) {
+    errs() << "tipc: -time-phases cannot be combined with -split\n";
+    return 1;
+  }
+
+  // the legacy pass managers time each pass they run
+  if (timing) {
+    TimePassesIsEnabled = true;
+  }
+
+  // the legacy pass managers dump their structure for -debug-pass=Structure
+  if (printPasses) {
+    cl::getRegisteredOptions()["debug-pass"]->addOccurrence(0, "debug-pass",
+                                                            "Structure");
+  }
+
+  if (runProgram) {
+    CompileJob job;
+    job.sourceFile = sourceFile;
+    LLVMContext TheContext;
+    auto theModule = generateModule(TheContext, job);
+    std::cout << job.output;
+    errs() << job.errors;
+    if (!theModule) {
+      return job.status;
+    }
+
+    // optimize for the host that the JIT will run the program on
+    theModule->setTargetTriple(sys::getProcessTriple());
+    optimizeModule(*theModule, nullptr, job.sourceFile);
+
+    std::vector<std::string> args(extraArgs.begin(), extraArgs.end());
+    int status = runTIPProgram(std::move(theModule), args);
+    reportPhaseTimes();
+    return status;
+  }
+
+  // without -run the remaining positional arguments are more source files
+  std::vector<CompileJob> jobs(1 + extraArgs.size());
+  jobs[0].sourceFile = sourceFile;
+  for (size_t i = 0; i < extraArgs.size(); i++) {
+    jobs[i + 1].sourceFile = extraArgs[i];
+  }
+
+  if (jobs.size() > 1 && !outputFile.empty()) {
+    errs() << "tipc: -o cannot be used with more than one source file\n";
+    return 1;
+  }
+
+  /*
+   * Workers take the next file to compile until none are left, nothing
+   * but the counter is shared because each compilation has its own
+   * contexts.
+   */
+  unsigned numWorkers = numJobs;
+  if (numWorkers == 0) {
+    numWorkers = std::max(1u, std::thread::hardware_concurrency());
+  }
+  numWorkers = std::min<size_t>(numWorkers, jobs.size());
+  if (timing && numWorkers > 1) {
+    errs() << "tipc: -time-phases cannot be combined with more than one "
+              "compile thread, -j\n";
+    return 1;
+  }
+
+  std::atomic<size_t> nextJob(0);
+  auto worker = [&jobs, &nextJob]() {
+    for (size_t j = nextJob++; j < jobs.size(); j = nextJob++) {
+      compileFile(jobs[j]);
+    }
+  };
+
+  if (numWorkers == 1) {
+    worker();
+  } else {
+    std::vector<std::thread> workers;
+    for (unsigned w = 0; w < numWorkers; w++) {
+      workers.emplace_back(worker);
+    }
+    for (auto &w : workers) {
+      w.join();
+    }
+  }
+
+  int status = 0;
+  for (auto const &job : jobs) {
+    std::cout << job.output;
+    errs() << job.errors;
+    status = std::max(status, job.status);
+  }
+  reportPhaseTimes();
+  return status;
 }
@@ -1,10 +1,14 @@
 #!/bin/sh
 if [ $# -lt 1 ]; then
-  echo "$0: you must provide a .tip file"
+  echo "$0: you must provide a .tip file, and optionally tipc options"
   exit 0;
 fi
 
+# the options following the file are passed to tipc
+tipfile=$1
 bname=`basename $1 .tip`
+shift
+flags="$*"
 
 # create a per user tmp directory for storing diff files
 if [ ! -d ~/tmp ]; then
@@ -13,8 +17,9 @@ fi
 
 # compile and run the test through tipc 
 #    we suppress warnings while linking because of a target triple mismatch
-../build/tipc $1
-clang-7 -w -static $1.bc ../intrinsics/tip_intrinsics.bc -o $bname
+#    and discard what tipc prints, such as the typed program of -t
+../build/tipc $flags $tipfile >/dev/null
+clang-7 -w -static $tipfile.bc ../intrinsics/tip_intrinsics.bc -o $bname
 ./$bname >~/tmp/$bname.tipc-out
 
 # create a tipc directory for storing source to run TIP Scala
@@ -25,9 +30,9 @@ fi
 # run the test through TIP Scala 
 #   must execute in its build directory
 #   reenable stty echo when finished
-cp $1 ~/TIP/tipc/
+cp $tipfile ~/TIP/tipc/
 cd ~/TIP
-./tip -run tipc/$1 >~/tmp/$bname.tipscala-out
+./tip -run tipc/$tipfile >~/tmp/$bname.tipscala-out
 stty echo
 cd - >/dev/null
 
@@ -38,7 +43,7 @@ cd - >/dev/null
 sed 's/\[\(0\|1\|31\)m//g' ~/tmp/$bname.tipscala-out >~/tmp/t
 cp ~/tmp/t ~/tmp/$bname.tipscala-out
 if diff ~/tmp/$bname.tipc-out ~/tmp/$bname.tipscala-out | grep -q -e "Program output" -e " Error: Execution error"; then
-  echo "$bname failed"
+  echo "$bname $flags failed"
 else
-  echo "$bname passed"
+  echo "$bname $flags passed"
 fi
@@ -12,4 +12,45 @@
 ./difftest.sh ptr4.tip
 ./difftest.sh ptr5.tip
 ./difftest.sh ptr6.tip
+./difftest.sh records.tip
 ./difftest.sh whileifs.tip
+./difftest.sh assignments.tip -t
+./difftest.sh exponential.tip -t
+./difftest.sh exprs.tip -t
+./difftest.sh fibs.tip -t
+./difftest.sh fun.tip -t
+./difftest.sh ifthenelse.tip -t
+./difftest.sh outputerror.tip -t
+./difftest.sh ptr1.tip -t
+./difftest.sh ptr2.tip -t
+./difftest.sh ptr3.tip -t
+./difftest.sh ptr4.tip -t
+./difftest.sh ptr5.tip -t
+./difftest.sh ptr6.tip -t
+./difftest.sh records.tip -t
+./difftest.sh whileifs.tip -t
+./difftest.sh alias.tip
+./difftest.sh ptr1.tip -points-to -O2
+./difftest.sh ptr2.tip -points-to -O2
+./difftest.sh ptr3.tip -points-to -O2
+./difftest.sh ptr4.tip -points-to -O2
+./difftest.sh ptr5.tip -points-to -O2
+./difftest.sh ptr6.tip -points-to -O2
+./difftest.sh records.tip -points-to -O2
+./difftest.sh alias.tip -points-to -O2
+./difftest.sh escape.tip
+./difftest.sh escape.tip -escape-analysis
+./difftest.sh escape.tip -escape-analysis -gc
+./difftest.sh fib.tip -memoize
+./difftest.sh fibs.tip -memoize
+./difftest.sh exponential.tip -memoize
+./difftest.sh memoimpure.tip
+./difftest.sh memoimpure.tip -memoize
+./difftest.sh fun.tip -split 4 -O2
+./difftest.sh fibs.tip -split 4 -O2
+./difftest.sh records.tip -t -split 3 -O2
+./difftest.sh split.tip
+./difftest.sh split.tip -split 4 -O2
+./difftest.sh split.tip -t -split 3 -O2
+./difftest.sh gc.tip
+./difftest.sh gc.tip -gc